@@ -1,29 +1,191 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <cassert>
+#include <sstream>
+#include <memory>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h> 
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <png.h>
-#include "Texture.h"
-#include "FurTexture.h"
-#include "FurGeometry.h"
+#include "FileCache.h"
+#include "Framebuffer.h"
+#include "FrameReport.h"
+#include "FurScene.h"
+#include "Profiler.h"
 #include "ShaderProgram.h"
+#include "TextureStreamer.h"
 
 using namespace std;
 
 const int CANVAS_WIDTH = 500;
 const int CANVAS_HEIGHT = 500;
-const int FUR_DIM = 512;
-const float FUR_DENSITY = 0.4f;
-const int FUR_LAYERS = 40;
-const int FUR_HEIGHT = 2.0;
+const char* CACHE_DIR = "cache";
+const int HEADLESS_SAMPLES = 4;
+const int HEADLESS_WARMUP_FRAMES = 5;
+const double HEADLESS_FRAME_TIME = 1.0 / 60.0;
+// GPU times are read back this many frames late so that waiting for them does
+// not stall the pipeline.
+const int GPU_QUERY_LATENCY = 4;
+// How often the window shows profiling statistics, in seconds.
+const double PROFILE_INTERVAL = 1.0;
+const float COLLIDER_RADIUS = 4.0f;
+
+static void usage(const char* program) {
+  cerr << "Usage: " << program << " [--grid n] [--mesh file.obj|file.ply]"
+       << " [--asset file.fur] [--profile] [--trace file.json]\n"
+       << "       " << program << " --headless [--frames n] [--sizes WxH,...]"
+       << " [--grid n] [--mesh file.obj|file.ply] [--asset file.fur]"
+       << " [--report file.csv|file.json] [--profile] [--trace file.json]\n";
+}
+
+/**
+ * Parses a comma-separated list of sizes such as "500x500,1920x1080".
+ * @return whether the whole list could be parsed
+ */
+static bool parseSizes(const char* text, vector<pair<int, int>>& sizes) {
+  sizes.clear();
+  stringstream list(text);
+  string item;
+  while (getline(list, item, ',')) {
+    int width, height;
+    char x;
+    stringstream size(item);
+    if (!(size >> width >> x >> height) || x != 'x' || width <= 0 || height <= 0) {
+      return false;
+    }
+    sizes.push_back(make_pair(width, height));
+  }
+  return !sizes.empty();
+}
+
+static double msSince(chrono::steady_clock::time_point start) {
+  chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/**
+ * Renders a fixed number of frames at every size into an offscreen framebuffer,
+ * with a fixed time step so that every run draws the same frames. CPU time covers
+ * submitting a frame; GPU time comes from a GL_TIME_ELAPSED query around it.
+ */
+static void runHeadless(FurScene& scene, int frames,
+  const vector<pair<int, int>>& sizes, FrameReport& report, Profiler* profiler) {
+  GLuint queries[GPU_QUERY_LATENCY];
+  glGenQueries(GPU_QUERY_LATENCY, queries);
+
+  for (const pair<int, int>& size : sizes) {
+    Framebuffer framebuffer(size.first, size.second, HEADLESS_SAMPLES);
+    framebuffer.bind();
+    for (int frame = 0; frame < HEADLESS_WARMUP_FRAMES; frame++) {
+      scene.render(frame * HEADLESS_FRAME_TIME, size.first, size.second);
+    }
+    glFinish();
+
+    report.beginRun(size.first, size.second);
+    for (int frame = 0; frame < frames; frame++) {
+      GLuint query = queries[frame % GPU_QUERY_LATENCY];
+      if (frame >= GPU_QUERY_LATENCY) {
+        GLuint64 ns;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        report.setGpuTime(frame - GPU_QUERY_LATENCY, ns / 1e6);
+      }
+
+      if (profiler) {
+        profiler->beginFrame();
+      }
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      glBeginQuery(GL_TIME_ELAPSED, query);
+      scene.render(frame * HEADLESS_FRAME_TIME, size.first, size.second, profiler);
+      glEndQuery(GL_TIME_ELAPSED);
+      report.addFrame(msSince(start), -1.0);
+      if (profiler) {
+        profiler->endFrame();
+      }
+    }
+
+    // Collect the queries still in flight.
+    for (int frame = max(frames - GPU_QUERY_LATENCY, 0); frame < frames; frame++) {
+      GLuint64 ns;
+      glGetQueryObjectui64v(queries[frame % GPU_QUERY_LATENCY], GL_QUERY_RESULT,
+        &ns);
+      report.setGpuTime(frame, ns / 1e6);
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteQueries(GPU_QUERY_LATENCY, queries);
+}
+
+/**
+ * Writes the profiler's trace to a file.
+ * @return whether the file could be written
+ */
+static bool writeTrace(const Profiler& profiler, const char* fileName) {
+  ofstream out(fileName);
+  profiler.writeTrace(out);
+  if (!out) {
+    cerr << "Could not write " << fileName << "\n";
+    return false;
+  }
+  return true;
+}
 
 int main(int argc, char** argv) {
   GLFWwindow* window;
+  FurScene::Settings settings;
+  bool headless = false;
+  int frames = 300;
+  vector<pair<int, int>> sizes(1, make_pair(CANVAS_WIDTH, CANVAS_HEIGHT));
+  const char* reportFile = NULL;
+  bool profile = false;
+  const char* traceFile = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--headless") == 0) {
+      headless = true;
+    }
+    else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+      frames = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--sizes") == 0 && hasValue) {
+      if (!parseSizes(argv[++i], sizes)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+    else if (strcmp(argv[i], "--grid") == 0 && hasValue) {
+      settings.grid = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--mesh") == 0 && hasValue) {
+      settings.meshFile = argv[++i];
+    }
+    else if (strcmp(argv[i], "--asset") == 0 && hasValue) {
+      settings.assetFile = argv[++i];
+    }
+    else if (strcmp(argv[i], "--report") == 0 && hasValue) {
+      reportFile = argv[++i];
+    }
+    else if (strcmp(argv[i], "--profile") == 0) {
+      profile = true;
+    }
+    else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+      profile = true;
+      traceFile = argv[++i];
+    }
+    else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (settings.assetFile && settings.grid > 0) {
+    cerr << "--asset draws a single patch and cannot be combined with --grid\n";
+    return EXIT_FAILURE;
+  }
 
   if (!glfwInit()) {
     return EXIT_FAILURE;
@@ -35,6 +197,8 @@ int main(int argc, char** argv) {
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   glfwWindowHint(GLFW_SAMPLES, 8);
+  // Headless runs render into a Framebuffer; the window only provides a context.
+  glfwWindowHint(GLFW_VISIBLE, headless ? GL_FALSE : GL_TRUE);
   
   // Initialize GLFW window.
   window = glfwCreateWindow(CANVAS_WIDTH, CANVAS_HEIGHT, "gldemo", NULL, NULL);
@@ -55,95 +219,111 @@ int main(int argc, char** argv) {
   }
   cout << "GLEW version: " << glewGetString(GLEW_VERSION) << "\n";
  
-  // Initialize shaders.
-  ShaderProgram prog("default.vert", "default.frag");
-  assert(prog.hasAttribute("pos"));
-  assert(prog.hasAttribute("texCoord"));
-  assert(prog.hasAttribute("layer"));
-  //assert(prog.hasAttribute("norm"));
-  assert(prog.hasUniform("modelView"));
-  assert(prog.hasUniform("projection"));
-  assert(prog.hasUniform("fur"));
-  assert(prog.hasUniform("color"));
-  assert(prog.hasUniform("displacement"));
-
-  prog.use();
-    
-  // Load textures.
-  glActiveTexture(GL_TEXTURE0);
-  FurTexture fur(FUR_DIM, FUR_DIM, FUR_LAYERS, FUR_DENSITY);
-  glUniform1i(prog.getUniform("fur"), 0);
-  
-  glActiveTexture(GL_TEXTURE1);
-  Texture furColor("grass.png");
-  glUniform1i(prog.getUniform("color"), 1);
-  
-  // Initialize geometry.
-  vector<FurAttributes> vertices;
-  
-  // A---B
-  // \   /
-  //  C-D
-  FurAttributes fa;
-  fa = {{ 20.0, -20.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0}, 0.0}; // D
-  vertices.push_back(fa);
-  fa = {{ 30.0,  20.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 1.0}, 0.0}; // B
-  vertices.push_back(fa);
-  fa = {{-30.0,  20.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 1.0}, 0.0}; // A
-  vertices.push_back(fa);
-  
-  fa = {{-30.0,  20.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 1.0}, 0.0}; // A
-  vertices.push_back(fa);
-  fa = {{-20.0, -20.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 0.0}, 0.0}; // C
-  vertices.push_back(fa);
-  fa = {{ 20.0, -20.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0}, 0.0}; // D
-  vertices.push_back(fa);
-  
-  FurGeometry geom(vertices, prog, FUR_LAYERS, FUR_HEIGHT);
+  // Linked programs are cached next to the fur maps. The color texture is
+  // streamed in over the first frames instead of stalling startup on the upload;
+  // headless runs upload it right away so that every frame is the same.
+  FileCache cache(CACHE_DIR);
+  TextureStreamer streamer;
+  double loadStart = glfwGetTime();
+  unique_ptr<FurScene> scene;
+  try {
+    scene.reset(new FurScene(settings, &cache, headless ? NULL : &streamer));
+  }
+  catch (const runtime_error& e) {
+    cerr << e.what() << "\n";
+    glfwTerminate();
+    return EXIT_FAILURE;
+  }
+  cout << "Scene built in " << (glfwGetTime() - loadStart) * 1000.0 << " ms\n";
+  const ShaderProgram::CacheStats& shaderStats = ShaderProgram::cacheStats();
+  cout << "Shader cache: " << shaderStats.hits << " hits, "
+    << shaderStats.misses << " misses, "
+    << shaderStats.secondsSaved * 1000.0 << " ms saved\n";
 
   // Gloabl GL stuff.
   glEnable(GL_MULTISAMPLE);
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
 
-  // Simple physics.
-  glm::vec3 gravity(0.0f, -0.8f, 0.0f);
-  
-  // Projection and model-view matrices.
-  glm::vec3 xAxis(1.0f, 0.0f, 0.0f);
-  glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -30.0f)) *
-    glm::rotate(glm::mat4(1.0f), glm::radians(-60.0f), xAxis);
-  glUniformMatrix4fv(prog.getUniform("modelView"), 1, GL_FALSE,
-    glm::value_ptr(view));
+  // Profiling costs two timestamp queries per stage, so it is off by default.
+  unique_ptr<Profiler> profiler;
+  if (profile) {
+    profiler.reset(new Profiler());
+    profiler->setTracing(traceFile != NULL);
+  }
+
+  if (headless) {
+    FrameReport report;
+    try {
+      runHeadless(*scene, frames, sizes, report, profiler.get());
+      report.writeSummary(cout);
+      if (reportFile) {
+        report.save(reportFile);
+      }
+      if (profiler) {
+        profiler->writeStats(cout);
+      }
+    }
+    catch (const runtime_error& e) {
+      cerr << e.what() << "\n";
+      glfwTerminate();
+      return EXIT_FAILURE;
+    }
+
+    if (traceFile && !writeTrace(*profiler, traceFile)) {
+      glfwTerminate();
+      return EXIT_FAILURE;
+    }
+    glfwTerminate();
+    return EXIT_SUCCESS;
+  }
 
+  double nextStats = PROFILE_INTERVAL;
   while (!glfwWindowShouldClose(window)) {
-    float ratio;
     int width, height;
     
-    glfwGetFramebufferSize(window, &width, &height);
-    ratio = width / (float) height;
+    if (profiler) {
+      profiler->beginFrame();
+    }
+    // Dragging with the left button pushes a ball through the fur.
+    if (scene->deformation() &&
+        glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+      double x, y;
+      int windowWidth, windowHeight;
+      glm::vec3 point;
+      glfwGetCursorPos(window, &x, &y);
+      glfwGetWindowSize(window, &windowWidth, &windowHeight);
+      if (scene->unproject(x, y, windowWidth, windowHeight, point)) {
+        scene->deformation()->addSphere(point + glm::vec3(0.0f, 0.0f, 1.0f),
+          COLLIDER_RADIUS);
+      }
+    }
     
-    glViewport(0, 0, width, height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);    
-    
-    glm::mat4 projection = glm::perspective(glm::radians(60.0f), ratio, 0.1f, 100.0f);
-    glUniformMatrix4fv(prog.getUniform("projection"), 1, GL_FALSE,
-      glm::value_ptr(projection));
-    
-    // Displacement/animation uniform.
-    glm::vec3 force(sin(glfwGetTime()) * 0.5f, 0.0f, 0.0f);
-    glm::vec3 disp = gravity + force;
-    glUniform3f(prog.getUniform("displacement"), disp.x, disp.y, disp.z);
-    
-    // Draw.
-    geom.draw();
+    glfwGetFramebufferSize(window, &width, &height);
+    scene->render(glfwGetTime(), width, height, profiler.get());
 
     // Display and continue.
-    glfwSwapBuffers(window);
+    {
+      Profiler::Scope scope(profiler.get(), "swap");
+      glfwSwapBuffers(window);
+    }
+    if (profiler) {
+      profiler->endFrame();
+    }
     glfwPollEvents();
+
+    // The title doubles as a minimal overlay; the full table goes to the console.
+    if (profiler && glfwGetTime() >= nextStats) {
+      nextStats = glfwGetTime() + PROFILE_INTERVAL;
+      FrameReport::Stats cpu = profiler->stats("frame", false);
+      FrameReport::Stats gpu = profiler->stats("frame", true);
+      char title[128];
+      snprintf(title, sizeof(title), "gldemo - cpu %.2f ms, gpu %.2f ms (p99 %.2f)",
+        cpu.mean, gpu.mean, gpu.p99);
+      glfwSetWindowTitle(window, title);
+      profiler->writeStats(cout);
+    }
   }
 
+  bool traced = !traceFile || writeTrace(*profiler, traceFile);
   glfwTerminate();
-  return EXIT_SUCCESS;
+  return traced ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,220 @@
+#include "DeformationMap.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Deformation shorter than this is treated as recovered.
+static const float REST_EPSILON = 1e-3f;
+// How much of the push goes sideways rather than down.
+static const float SIDEWAYS_PUSH = 0.5f;
+
+DeformationMap::DeformationMap(int width, int height, const glm::vec3& origin,
+  const glm::vec3& uAxis, const glm::vec3& vAxis, float reach, float recovery)
+  : _width(width), _height(height), _tilesX((width + TILE - 1) / TILE),
+    _tilesY((height + TILE - 1) / TILE), _origin(origin), _uAxis(uAxis),
+    _vAxis(vAxis), _normal(glm::normalize(glm::cross(uAxis, vAxis))),
+    _reach(reach), _recovery(recovery), _maxDeformation(0.0f),
+    _uploadedTexels(0) {
+  _texels.assign((size_t)_width * _height * 3, 0.0f);
+  _tileActive.assign(_tilesX * _tilesY, 0);
+  _tileDirty.assign(_tilesX * _tilesY, 0);
+  
+  glGenTextures(1, &_texture);
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, _width, _height, 0, GL_RGB, GL_FLOAT,
+    &_texels[0]);
+}
+
+DeformationMap::~DeformationMap() {
+  glDeleteTextures(1, &_texture);
+}
+
+void DeformationMap::markDirty(int tile) {
+  if (!_tileDirty[tile]) {
+    _tileDirty[tile] = 1;
+    _dirtyTiles.push_back(tile);
+  }
+}
+
+void DeformationMap::stamp(const glm::vec3& a, const glm::vec3& b, float radius) {
+  // Only texels under the capsule's bounding box in texture space can be touched.
+  const float uLength2 = glm::dot(_uAxis, _uAxis);
+  const float vLength2 = glm::dot(_vAxis, _vAxis);
+  float ua = glm::dot(a - _origin, _uAxis) / uLength2;
+  float ub = glm::dot(b - _origin, _uAxis) / uLength2;
+  float va = glm::dot(a - _origin, _vAxis) / vLength2;
+  float vb = glm::dot(b - _origin, _vAxis) / vLength2;
+  float ru = radius / sqrt(uLength2);
+  float rv = radius / sqrt(vLength2);
+  int x0 = max((int)floor((min(ua, ub) - ru) * _width), 0);
+  int x1 = min((int)ceil((max(ua, ub) + ru) * _width), _width);
+  int y0 = max((int)floor((min(va, vb) - rv) * _height), 0);
+  int y1 = min((int)ceil((max(va, vb) + rv) * _height), _height);
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+  
+  const glm::vec3 axis = b - a;
+  const float axisLength2 = glm::dot(axis, axis);
+  for (int y = y0; y < y1; y++) {
+    for (int x = x0; x < x1; x++) {
+      glm::vec3 base = _origin + ((x + 0.5f) / _width) * _uAxis +
+        ((y + 0.5f) / _height) * _vAxis;
+  
+      // The nearest point of the capsule's axis acts as a sphere over this texel.
+      float t = (axisLength2 > 0.0f) ?
+        glm::clamp(glm::dot(base - a, axis) / axisLength2, 0.0f, 1.0f) : 0.0f;
+      glm::vec3 offset = base - (a + t * axis);
+      float height = -glm::dot(offset, _normal);
+      glm::vec3 planar = offset + height * _normal;
+  
+      // The sphere presses on the hair wherever it dips below the hair tips.
+      float gap = max(height - _reach, 0.0f);
+      if (height < -radius || gap >= radius) {
+        continue;
+      }
+      float footprint = sqrt(radius * radius - gap * gap);
+      float distance = glm::length(planar);
+      float depth = footprint - distance;
+      if (depth <= 0.0f) {
+        continue;
+      }
+  
+      glm::vec3 push = -min(depth, _reach) * _normal;
+      if (distance > 0.0f) {
+        push += planar * (SIDEWAYS_PUSH * depth / distance);
+      }
+  
+      // Overlapping colliders do not add up; the strongest push wins.
+      float* texel = &_texels[((size_t)y * _width + x) * 3];
+      glm::vec3 current(texel[0], texel[1], texel[2]);
+      if (glm::dot(push, push) <= glm::dot(current, current)) {
+        continue;
+      }
+      texel[0] = push.x;
+      texel[1] = push.y;
+      texel[2] = push.z;
+      _maxDeformation = max(_maxDeformation, glm::length(push));
+  
+      int tile = (y / TILE) * _tilesX + x / TILE;
+      if (!_tileActive[tile]) {
+        _tileActive[tile] = 1;
+        _activeTiles.push_back(tile);
+      }
+      markDirty(tile);
+    }
+  }
+}
+
+void DeformationMap::addSphere(const glm::vec3& center, float radius) {
+  stamp(center, center, radius);
+}
+
+void DeformationMap::addCapsule(const glm::vec3& a, const glm::vec3& b,
+  float radius) {
+  stamp(a, b, radius);
+}
+
+bool DeformationMap::recoverTile(int tile, float factor, float& maxSquared) {
+  const int x0 = (tile % _tilesX) * TILE;
+  const int y0 = (tile / _tilesX) * TILE;
+  const int x1 = min(x0 + TILE, _width);
+  const int y1 = min(y0 + TILE, _height);
+  
+  float tileMax = 0.0f;
+  for (int y = y0; y < y1; y++) {
+    float* texel = &_texels[((size_t)y * _width + x0) * 3];
+    for (int i = 0; i < (x1 - x0) * 3; i += 3) {
+      texel[i] *= factor;
+      texel[i + 1] *= factor;
+      texel[i + 2] *= factor;
+      tileMax = max(tileMax, texel[i] * texel[i] + texel[i + 1] * texel[i + 1] +
+        texel[i + 2] * texel[i + 2]);
+    }
+  }
+  markDirty(tile);
+  
+  if (tileMax >= REST_EPSILON * REST_EPSILON) {
+    maxSquared = max(maxSquared, tileMax);
+    return true;
+  }
+  
+  // Settle the remainder so the tile can go idle.
+  for (int y = y0; y < y1; y++) {
+    fill_n(&_texels[((size_t)y * _width + x0) * 3], (x1 - x0) * 3, 0.0f);
+  }
+  return false;
+}
+
+void DeformationMap::update(double dt) {
+  const float factor = (float)exp(-_recovery * dt);
+  float maxSquared = 0.0f;
+  size_t kept = 0;
+  for (size_t i = 0; i < _activeTiles.size(); i++) {
+    int tile = _activeTiles[i];
+    if (recoverTile(tile, factor, maxSquared)) {
+      _activeTiles[kept++] = tile;
+    }
+    else {
+      _tileActive[tile] = 0;
+    }
+  }
+  _activeTiles.resize(kept);
+  _maxDeformation = sqrt(maxSquared);
+}
+
+void DeformationMap::bind() {
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  _uploadedTexels = 0;
+  if (_dirtyTiles.empty()) {
+    return;
+  }
+  
+  // Neighbouring tiles in a row of tiles go up as one rectangle.
+  sort(_dirtyTiles.begin(), _dirtyTiles.end());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, _width);
+  size_t i = 0;
+  while (i < _dirtyTiles.size()) {
+    int first = _dirtyTiles[i];
+    int last = first;
+    _tileDirty[first] = 0;
+    while (i + 1 < _dirtyTiles.size() && _dirtyTiles[i + 1] == last + 1 &&
+        _dirtyTiles[i + 1] % _tilesX != 0) {
+      last = _dirtyTiles[++i];
+      _tileDirty[last] = 0;
+    }
+    i++;
+  
+    int x0 = (first % _tilesX) * TILE;
+    int y0 = (first / _tilesX) * TILE;
+    int x1 = min((last % _tilesX + 1) * TILE, _width);
+    int y1 = min(y0 + TILE, _height);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_RGB, GL_FLOAT,
+      &_texels[((size_t)y0 * _width + x0) * 3]);
+    _uploadedTexels += (size_t)(x1 - x0) * (y1 - y0);
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  _dirtyTiles.clear();
+}
+
+float DeformationMap::maxDeformation() const {
+  return _maxDeformation;
+}
+
+size_t DeformationMap::uploadedTexels() const {
+  return _uploadedTexels;
+}
+
+int DeformationMap::width() const {
+  return _width;
+}
+
+int DeformationMap::height() const {
+  return _height;
+}
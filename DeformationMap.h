@@ -0,0 +1,110 @@
+#ifndef _DEFORMATIONMAP_H_
+#define _DEFORMATIONMAP_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * Where objects have pushed a patch's hair aside, by texture coordinate. Sphere
+ * and capsule colliders press the hair flat and outwards, and the hair springs
+ * back over time.
+ *
+ * The map is split into square tiles. Only tiles holding deformation are
+ * recovered each frame, and only tiles that changed are uploaded, merged into
+ * one glTexSubImage2D() per run of neighbouring tiles, so the per-frame cost
+ * follows the deformed area rather than the size of the map.
+ */
+class DeformationMap {
+  static const int TILE = 16;
+
+  int _width;
+  int _height;
+  int _tilesX;
+  int _tilesY;
+  glm::vec3 _origin;
+  glm::vec3 _uAxis;
+  glm::vec3 _vAxis;
+  glm::vec3 _normal;
+  float _reach;
+  float _recovery;
+  GLuint _texture;
+  // RGB displacement per texel, bottom row first.
+  std::vector<float> _texels;
+  std::vector<unsigned char> _tileActive;
+  std::vector<unsigned char> _tileDirty;
+  std::vector<int> _activeTiles;
+  std::vector<int> _dirtyTiles;
+  float _maxDeformation;
+  size_t _uploadedTexels;
+
+  DeformationMap(const DeformationMap&);
+  DeformationMap& operator=(const DeformationMap&);
+
+  void stamp(const glm::vec3& a, const glm::vec3& b, float radius);
+  void markDirty(int tile);
+  bool recoverTile(int tile, float factor, float& maxSquared);
+
+public:
+  /**
+   * Creates an undeformed map and its texture. The map covers a flat patch: the
+   * texel at (u, v) lies at origin + u * uAxis + v * vAxis. Needs a current OpenGL
+   * context; the texture is bound to the active texture unit.
+   * @param width the number of texels along u
+   * @param height the number of texels along v
+   * @param origin the model-space position of texture coordinate (0, 0)
+   * @param uAxis the model-space span of u from 0 to 1
+   * @param vAxis the model-space span of v from 0 to 1
+   * @param reach how far above the surface colliders touch the hair, usually the
+   *              hair length
+   * @param recovery how quickly hair springs back, as a fraction per second
+   */
+  DeformationMap(int width, int height, const glm::vec3& origin,
+    const glm::vec3& uAxis, const glm::vec3& vAxis, float reach,
+    float recovery = 1.5f);
+  ~DeformationMap();
+
+  /**
+   * Pushes the hair out of a sphere.
+   * @param center the center of the sphere, in model space
+   * @param radius the radius of the sphere
+   */
+  void addSphere(const glm::vec3& center, float radius);
+
+  /**
+   * Pushes the hair out of a capsule, e.g. a limb or a rolling object.
+   * @param a one end of the capsule's axis, in model space
+   * @param b the other end of the capsule's axis, in model space
+   * @param radius the radius of the capsule
+   */
+  void addCapsule(const glm::vec3& a, const glm::vec3& b, float radius);
+
+  /**
+   * Lets deformed hair spring back.
+   * @param dt the time since the last update, in seconds
+   */
+  void update(double dt);
+
+  /**
+   * Uploads the tiles that changed since the last call and binds the texture to
+   * the active texture unit.
+   */
+  void bind();
+
+  /**
+   * Returns the length of the largest deformation, for culling.
+   * @return the largest deformation
+   */
+  float maxDeformation() const;
+
+  /**
+   * Returns the number of texels the last bind() uploaded.
+   * @return the number of texels uploaded
+   */
+  size_t uploadedTexels() const;
+
+  int width() const;
+  int height() const;
+};
+
+#endif
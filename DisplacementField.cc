@@ -0,0 +1,192 @@
+#include "DisplacementField.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+const double DisplacementField::STEP = 1.0 / 120.0;
+
+// About 1.6 Hz; each cell varies this by up to 40% either way.
+static const float BASE_STIFFNESS = 100.0f;
+static const float STIFFNESS_VARIATION = 0.4f;
+// Gusts cross the patch twice along u and once along v, at about half a wave per
+// second.
+static const float GUST_WAVES_U = 2.0f;
+static const float GUST_WAVES_V = 1.0f;
+static const float GUST_SPEED = 3.0f;
+// Time carried over between updates is capped at this many steps.
+static const int MAX_PENDING_STEPS = 12;
+static const float TWO_PI = 6.2831853f;
+
+/**
+ * The SplitMix64 finalizer, as used by FurTexture.
+ */
+static inline uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+DisplacementField::DisplacementField(int width, int height, uint32_t seed,
+  WorkerPool& pool)
+  : _width(width), _height(height), _pool(pool), _wind(0.0f), _gustiness(0.5f),
+    _damping(4.0f), _budgetMs(0.0), _time(0.0), _pending(0.0), _stepMs(0.0),
+    _maxDisplacement(0.0f), _dirty(false) {
+  const size_t cells = (size_t)_width * _height;
+  for (int axis = 0; axis < 3; axis++) {
+    _position[axis].assign(cells, 0.0f);
+    _velocity[axis].assign(cells, 0.0f);
+  }
+  _staging.assign(cells * 3, 0.0f);
+  _rowMax.assign(_height, 0.0f);
+  
+  const uint64_t seedKey = mix64(seed);
+  _stiffness.resize(cells);
+  for (size_t i = 0; i < cells; i++) {
+    float r = (float)(mix64(seedKey ^ i) >> 40) * (1.0f / 16777216.0f);
+    _stiffness[i] = BASE_STIFFNESS *
+      (1.0f + STIFFNESS_VARIATION * (2.0f * r - 1.0f));
+  }
+  
+  // sin(a + b) = sin(a) cos(b) + cos(a) sin(b) keeps the per-cell gust free of
+  // trigonometry: a only depends on the column and b on the row and time.
+  _gustSin.resize(_width);
+  _gustCos.resize(_width);
+  for (int x = 0; x < _width; x++) {
+    float u = (x + 0.5f) / _width;
+    _gustSin[x] = sin(TWO_PI * GUST_WAVES_U * u);
+    _gustCos[x] = cos(TWO_PI * GUST_WAVES_U * u);
+  }
+  
+  glGenTextures(1, &_texture);
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, _width, _height, 0, GL_RGB, GL_FLOAT,
+    &_staging[0]);
+}
+
+DisplacementField::~DisplacementField() {
+  glDeleteTextures(1, &_texture);
+}
+
+void DisplacementField::setWind(const glm::vec3& wind, float gustiness) {
+  _wind = wind;
+  _gustiness = gustiness;
+}
+
+void DisplacementField::setDamping(float damping) {
+  _damping = damping;
+}
+
+void DisplacementField::setBudget(double ms) {
+  _budgetMs = ms;
+}
+
+void DisplacementField::stepRows(int begin, int end, int steps) {
+  const float h = (float)STEP;
+  const float damping = _damping;
+  const float gustiness = _gustiness;
+  const float wind[3] = { _wind.x, _wind.y, _wind.z };
+  float* position[3] = { &_position[0][0], &_position[1][0], &_position[2][0] };
+  float* velocity[3] = { &_velocity[0][0], &_velocity[1][0], &_velocity[2][0] };
+  const float* stiffness = &_stiffness[0];
+  const float* gustSin = &_gustSin[0];
+  const float* gustCos = &_gustCos[0];
+  
+  for (int y = begin; y < end; y++) {
+    const size_t row = (size_t)y * _width;
+    const float v = (y + 0.5f) / _height;
+  
+    for (int step = 0; step < steps; step++) {
+      float phase = TWO_PI * GUST_WAVES_V * v -
+        GUST_SPEED * (float)(_time + step * STEP);
+      float sinB = sin(phase);
+      float cosB = cos(phase);
+  
+      // Semi-implicit Euler: a = k (target - p) - c v.
+      for (int axis = 0; axis < 3; axis++) {
+        float* p = position[axis] + row;
+        float* vel = velocity[axis] + row;
+        const float* k = stiffness + row;
+        for (int x = 0; x < _width; x++) {
+          float gust = 1.0f + gustiness * (gustSin[x] * cosB + gustCos[x] * sinB);
+          float a = k[x] * (wind[axis] * gust - p[x]) - damping * vel[x];
+          vel[x] += a * h;
+          p[x] += vel[x] * h;
+        }
+      }
+    }
+  
+    // Interleave for upload and find the row's largest displacement.
+    float* out = &_staging[row * 3];
+    float rowMax = 0.0f;
+    for (int x = 0; x < _width; x++) {
+      float dx = position[0][row + x];
+      float dy = position[1][row + x];
+      float dz = position[2][row + x];
+      out[x * 3] = dx;
+      out[x * 3 + 1] = dy;
+      out[x * 3 + 2] = dz;
+      rowMax = max(rowMax, dx * dx + dy * dy + dz * dz);
+    }
+    _rowMax[y] = rowMax;
+  }
+}
+
+int DisplacementField::update(double dt) {
+  _pending = min(_pending + max(dt, 0.0), MAX_PENDING_STEPS * STEP);
+  int due = (int)(_pending / STEP);
+  if (due == 0) {
+    return 0;
+  }
+  _pending -= due * STEP;
+  
+  int steps = due;
+  if (_budgetMs > 0.0 && _stepMs > 0.0) {
+    steps = max(1, min(due, (int)(_budgetMs / _stepMs)));
+  }
+  
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  // Chunks of a few thousand cells keep the scheduling overhead small.
+  int grain = max(1, 4096 / _width);
+  _pool.parallelFor(_height, grain, [this, steps](int begin, int end) {
+    stepRows(begin, end, steps);
+  });
+  chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+  
+  // Smooth the cost estimate so one slow frame does not stall the simulation.
+  double stepMs = elapsed.count() / steps;
+  _stepMs = (_stepMs > 0.0) ? 0.8 * _stepMs + 0.2 * stepMs : stepMs;
+  
+  _time += steps * STEP;
+  _maxDisplacement = sqrt(*max_element(_rowMax.begin(), _rowMax.end()));
+  _dirty = true;
+  return steps;
+}
+
+void DisplacementField::bind() {
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  if (_dirty) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, GL_RGB, GL_FLOAT,
+      &_staging[0]);
+    _dirty = false;
+  }
+}
+
+float DisplacementField::maxDisplacement() const {
+  return _maxDisplacement;
+}
+
+int DisplacementField::width() const {
+  return _width;
+}
+
+int DisplacementField::height() const {
+  return _height;
+}
@@ -0,0 +1,115 @@
+#ifndef _DISPLACEMENTFIELD_H_
+#define _DISPLACEMENTFIELD_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "WorkerPool.h"
+
+/**
+ * A grid of spring-damper cells over a patch's texture coordinates, each holding
+ * the displacement of the hair tips above it. Wind pushes the cells and springs
+ * pull them back, so hair sways locally instead of all in step.
+ *
+ * Cells are stored as separate position and velocity arrays per axis, so the
+ * inner loops run over contiguous floats. Rows are stepped in parallel on a
+ * WorkerPool, with a fixed time step; update() stops once it has used up its
+ * per-frame budget, and the simulation slows down rather than falling behind.
+ * Cells do not interact, so each row runs all of a frame's steps in one pass.
+ * The result is uploaded to an RGB32F texture the vertex shaders sample by UV.
+ */
+class DisplacementField {
+  int _width;
+  int _height;
+  WorkerPool& _pool;
+  GLuint _texture;
+  // Per cell, by axis.
+  std::vector<float> _position[3];
+  std::vector<float> _velocity[3];
+  // Per cell: spring stiffness, varied so neighbouring cells drift out of phase.
+  std::vector<float> _stiffness;
+  // Per column: the sine and cosine of the gust phase along u.
+  std::vector<float> _gustSin;
+  std::vector<float> _gustCos;
+  // Interleaved RGB copy of the positions, for upload.
+  std::vector<float> _staging;
+  std::vector<float> _rowMax;
+  glm::vec3 _wind;
+  float _gustiness;
+  float _damping;
+  double _budgetMs;
+  double _time;
+  double _pending;
+  double _stepMs;
+  float _maxDisplacement;
+  bool _dirty;
+
+  DisplacementField(const DisplacementField&);
+  DisplacementField& operator=(const DisplacementField&);
+
+  void stepRows(int begin, int end, int steps);
+
+public:
+  /**
+   * The length of one simulation step, in seconds.
+   */
+  static const double STEP;
+
+  /**
+   * Creates a field at rest and its texture. Needs a current OpenGL context; the
+   * texture is bound to the active texture unit.
+   * @param width the number of cells along u
+   * @param height the number of cells along v
+   * @param seed seeds the per-cell variation
+   * @param pool the threads to step with
+   */
+  DisplacementField(int width, int height, uint32_t seed = 0,
+    WorkerPool& pool = WorkerPool::shared());
+  ~DisplacementField();
+
+  /**
+   * Sets the wind. Gusts travel across the patch and scale the wind by up to
+   * 1 +/- gustiness.
+   * @param wind the displacement a steady wind holds the hair at, in model space
+   * @param gustiness how much gusts vary the wind, from 0 to 1
+   */
+  void setWind(const glm::vec3& wind, float gustiness = 0.5f);
+
+  /**
+   * Sets how quickly cells stop swinging.
+   * @param damping the damping coefficient, per second
+   */
+  void setDamping(float damping);
+
+  /**
+   * Sets the CPU time update() may spend per call.
+   * @param ms the budget, in milliseconds; 0 for no limit
+   */
+  void setBudget(double ms);
+
+  /**
+   * Advances the simulation by dt seconds in fixed steps. Time shorter than a step
+   * carries over to the next call; steps that do not fit in the budget, judged
+   * by the cost of earlier steps, are dropped.
+   * @param dt the time since the last update, in seconds
+   * @return the number of steps taken
+   */
+  int update(double dt);
+
+  /**
+   * Uploads the field if it changed since the last upload and binds its texture
+   * to the active texture unit.
+   */
+  void bind();
+
+  /**
+   * Returns the length of the largest displacement in the field, for culling.
+   * @return the largest displacement
+   */
+  float maxDisplacement() const;
+
+  int width() const;
+  int height() const;
+};
+
+#endif
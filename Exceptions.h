@@ -16,9 +16,29 @@ public:
   ShaderError(const string& error) : runtime_error(error) {}
 };
 
+class IOError : public runtime_error {
+public:
+  IOError(const string& error) : runtime_error(error) {}
+};
+
 class PNGError : public runtime_error {
 public:
   PNGError(const string& error) : runtime_error(error) {}
 };
 
+class FramebufferError : public runtime_error {
+public:
+  FramebufferError(const string& error) : runtime_error(error) {}
+};
+
+class MeshError : public runtime_error {
+public:
+  MeshError(const string& error) : runtime_error(error) {}
+};
+
+class AssetError : public runtime_error {
+public:
+  AssetError(const string& error) : runtime_error(error) {}
+};
+
 #endif
@@ -0,0 +1,91 @@
+#include "FileCache.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include "Exceptions.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static long processId() {
+#ifdef _WIN32
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+FileCache::FileCache(const string& directory) : _directory(directory) {
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+}
+
+uint64_t FileCache::hash(const void* data, size_t size, uint64_t seed) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  uint64_t result = seed;
+  for (size_t i = 0; i < size; i++) {
+    result = (result ^ bytes[i]) * 1099511628211ull;
+  }
+  return result;
+}
+
+string FileCache::path(uint64_t key, const char* extension) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+  return _directory + "/" + name + extension;
+}
+
+shared_ptr<MappedFile> FileCache::load(uint64_t key, const char* extension) const {
+  try {
+    return make_shared<MappedFile>(path(key, extension).c_str());
+  }
+  catch (IOError&) {
+    return shared_ptr<MappedFile>();
+  }
+}
+
+bool FileCache::store(uint64_t key, const char* extension, const void* header,
+  size_t headerSize, const void* body, size_t bodySize) const {
+  string finalPath = path(key, extension);
+  
+  // Give every writer its own temporary file so concurrent writers don't
+  // interleave their writes. Thread ids repeat across processes, so the process
+  // id tells those apart.
+  ostringstream tempPath;
+  tempPath << finalPath << "." << hex << processId() << "."
+           << std::hash<thread::id>()(this_thread::get_id())
+           << chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+  
+  {
+    ofstream file(tempPath.str().c_str(), ios::binary | ios::trunc);
+    file.write((const char*)header, headerSize);
+    file.write((const char*)body, bodySize);
+    file.close();
+    if (file.fail()) {
+      remove(tempPath.str().c_str());
+      return false;
+    }
+  }
+  
+  if (rename(tempPath.str().c_str(), finalPath.c_str()) != 0) {
+    // Most likely another process stored the same entry first.
+    remove(tempPath.str().c_str());
+    return false;
+  }
+  
+  return true;
+}
@@ -0,0 +1,68 @@
+#ifndef _FILECACHE_H_
+#define _FILECACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "MappedFile.h"
+
+/**
+ * A directory of content-addressed files. Each entry is named after a 64-bit hash
+ * of whatever produced it, so entries never have to be invalidated, and several
+ * processes can share one directory.
+ */
+class FileCache {
+  std::string _directory;
+
+public:
+  /**
+   * Opens a cache directory, creating it if it does not exist yet.
+   * @param directory the path to the cache directory
+   */
+  explicit FileCache(const std::string& directory);
+
+  /**
+   * Hashes a block of bytes (64-bit FNV-1a). Pass the previous result as the seed
+   * to hash several blocks as one.
+   * @param data the bytes to hash
+   * @param size the number of bytes
+   * @param seed the hash to continue from
+   * @return the hash
+   */
+  static uint64_t hash(const void* data, size_t size,
+    uint64_t seed = 14695981039346656037ull);
+
+  /**
+   * Returns the path of the entry for a key.
+   * @param key the hash identifying the entry
+   * @param extension the file extension, including the dot
+   * @return the path to the entry
+   */
+  std::string path(uint64_t key, const char* extension) const;
+
+  /**
+   * Maps an entry into memory.
+   * @param key the hash identifying the entry
+   * @param extension the file extension, including the dot
+   * @return the mapped entry, or an empty pointer if there is no such entry
+   */
+  std::shared_ptr<MappedFile> load(uint64_t key, const char* extension) const;
+
+  /**
+   * Writes an entry consisting of a header followed by a body. The entry is
+   * written to a temporary file first and then renamed into place, so readers
+   * never see a partial entry. Failures are not fatal; the entry is just missing.
+   * @param key the hash identifying the entry
+   * @param extension the file extension, including the dot
+   * @param header the header bytes
+   * @param headerSize the number of header bytes
+   * @param body the body bytes
+   * @param bodySize the number of body bytes
+   * @return whether the entry was written
+   */
+  bool store(uint64_t key, const char* extension, const void* header,
+    size_t headerSize, const void* body, size_t bodySize) const;
+};
+
+#endif
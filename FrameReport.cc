@@ -0,0 +1,133 @@
+#include "FrameReport.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "Exceptions.h"
+
+using namespace std;
+
+/**
+ * Returns the nearest-rank percentile of sorted values.
+ */
+static double percentile(const vector<double>& sorted, double p) {
+  size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void writeStats(ostream& out, const FrameReport::Stats& stats) {
+  out << "{\"count\": " << stats.count << ", \"min\": " << stats.min
+      << ", \"mean\": " << stats.mean << ", \"p50\": " << stats.p50
+      << ", \"p90\": " << stats.p90 << ", \"p99\": " << stats.p99
+      << ", \"max\": " << stats.max << "}";
+}
+
+void FrameReport::beginRun(int width, int height) {
+  Run run;
+  run.width = width;
+  run.height = height;
+  _runs.push_back(run);
+}
+
+void FrameReport::addFrame(double cpuMs, double gpuMs) {
+  Frame frame = { cpuMs, gpuMs };
+  _runs.back().frames.push_back(frame);
+}
+
+void FrameReport::setGpuTime(size_t frame, double gpuMs) {
+  _runs.back().frames[frame].gpuMs = gpuMs;
+}
+
+const vector<FrameReport::Run>& FrameReport::runs() const {
+  return _runs;
+}
+
+FrameReport::Stats FrameReport::stats(const Run& run, bool gpu) {
+  vector<double> times;
+  for (const Frame& frame : run.frames) {
+    double ms = gpu ? frame.gpuMs : frame.cpuMs;
+    if (ms >= 0.0) {
+      times.push_back(ms);
+    }
+  }
+  return summarize(times);
+}
+
+FrameReport::Stats FrameReport::summarize(vector<double>& times) {
+  Stats stats = Stats();
+  if (times.empty()) {
+    return stats;
+  }
+  
+  sort(times.begin(), times.end());
+  double sum = 0.0;
+  for (double ms : times) {
+    sum += ms;
+  }
+  stats.count = times.size();
+  stats.min = times.front();
+  stats.mean = sum / times.size();
+  stats.p50 = percentile(times, 50.0);
+  stats.p90 = percentile(times, 90.0);
+  stats.p99 = percentile(times, 99.0);
+  stats.max = times.back();
+  return stats;
+}
+
+void FrameReport::writeCsv(ostream& out) const {
+  out << "width,height,frame,cpu_ms,gpu_ms\n";
+  for (const Run& run : _runs) {
+    for (size_t i = 0; i < run.frames.size(); i++) {
+      out << run.width << "," << run.height << "," << i << ","
+          << run.frames[i].cpuMs << ",";
+      if (run.frames[i].gpuMs >= 0.0) {
+        out << run.frames[i].gpuMs;
+      }
+      out << "\n";
+    }
+  }
+}
+
+void FrameReport::writeJson(ostream& out) const {
+  out << "[\n";
+  for (size_t i = 0; i < _runs.size(); i++) {
+    const Run& run = _runs[i];
+    out << "  {\"width\": " << run.width << ", \"height\": " << run.height
+        << ",\n   \"cpu_ms\": ";
+    writeStats(out, stats(run, false));
+    out << ",\n   \"gpu_ms\": ";
+    writeStats(out, stats(run, true));
+    out << "}" << (i + 1 < _runs.size() ? "," : "") << "\n";
+  }
+  out << "]\n";
+}
+
+void FrameReport::writeSummary(ostream& out) const {
+  out << "size\tframes\tcpu p50\tcpu p99\tgpu p50\tgpu p99 (ms)\n";
+  for (const Run& run : _runs) {
+    Stats cpu = stats(run, false);
+    Stats gpu = stats(run, true);
+    out << run.width << "x" << run.height << "\t" << run.frames.size() << "\t"
+        << cpu.p50 << "\t" << cpu.p99 << "\t" << gpu.p50 << "\t" << gpu.p99
+        << "\n";
+  }
+}
+
+void FrameReport::save(const string& fileName) const {
+  ofstream out(fileName.c_str());
+  if (!out) {
+    throw IOError("Could not write " + fileName);
+  }
+  
+  const string json = ".json";
+  if (fileName.size() >= json.size() &&
+      fileName.compare(fileName.size() - json.size(), json.size(), json) == 0) {
+    writeJson(out);
+  }
+  else {
+    writeCsv(out);
+  }
+  
+  if (!out) {
+    throw IOError("Could not write " + fileName);
+  }
+}
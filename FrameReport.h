@@ -0,0 +1,112 @@
+#ifndef _FRAMEREPORT_H_
+#define _FRAMEREPORT_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Collects per-frame CPU and GPU times over one or more runs, e.g. one run per
+ * resolution, and summarizes them as percentiles.
+ */
+class FrameReport {
+public:
+  /**
+   * The times of one frame, in milliseconds. gpuMs is negative if unknown.
+   */
+  struct Frame {
+    double cpuMs;
+    double gpuMs;
+  };
+
+  /**
+   * The frames rendered at one resolution.
+   */
+  struct Run {
+    int width;
+    int height;
+    std::vector<Frame> frames;
+  };
+
+  /**
+   * Summary statistics of one series of times, in milliseconds.
+   */
+  struct Stats {
+    size_t count;
+    double min;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+  };
+
+private:
+  std::vector<Run> _runs;
+
+public:
+  /**
+   * Starts a new run; later frames are added to it.
+   * @param width the width rendered at, in pixels
+   * @param height the height rendered at, in pixels
+   */
+  void beginRun(int width, int height);
+
+  /**
+   * Adds a frame to the current run.
+   * @param cpuMs the CPU time spent submitting the frame
+   * @param gpuMs the GPU time spent drawing the frame, or negative if unknown
+   */
+  void addFrame(double cpuMs, double gpuMs);
+
+  /**
+   * Sets the GPU time of a frame already added to the current run. GPU times
+   * usually arrive a few frames late.
+   * @param frame the index of the frame in the current run
+   * @param gpuMs the GPU time spent drawing the frame
+   */
+  void setGpuTime(size_t frame, double gpuMs);
+
+  const std::vector<Run>& runs() const;
+
+  /**
+   * Summarizes the CPU or GPU times of a run. Frames without a GPU time are left
+   * out of the GPU statistics.
+   * @param run the run to summarize
+   * @param gpu whether to summarize GPU times rather than CPU times
+   * @return the statistics; all zero if there were no times
+   */
+  static Stats stats(const Run& run, bool gpu);
+
+  /**
+   * Summarizes a series of times.
+   * @param times the times, in milliseconds; sorted in place
+   * @return the statistics; all zero if there were no times
+   */
+  static Stats summarize(std::vector<double>& times);
+
+  /**
+   * Writes one line per frame: width,height,frame,cpu_ms,gpu_ms.
+   */
+  void writeCsv(std::ostream& out) const;
+
+  /**
+   * Writes the statistics of every run as a JSON array.
+   */
+  void writeJson(std::ostream& out) const;
+
+  /**
+   * Writes a short human-readable summary of every run.
+   */
+  void writeSummary(std::ostream& out) const;
+
+  /**
+   * Writes the report to a file, as JSON if its name ends in ".json" and as CSV
+   * otherwise.
+   * @param fileName the file to write
+   * @throws IOError if the file could not be written
+   */
+  void save(const std::string& fileName) const;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "Framebuffer.h"
+#include <sstream>
+
+using namespace std;
+
+void Framebuffer::check(GLenum target) {
+  GLenum status = glCheckFramebufferStatus(target);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    stringstream error;
+    error << "Framebuffer incomplete: 0x" << hex << status;
+    throw FramebufferError(error.str());
+  }
+}
+
+Framebuffer::Framebuffer(int width, int height, int samples)
+  : _width(width), _height(height), _samples(samples), _resolveFramebuffer(0),
+    _resolveColor(0) {
+  GLint previous;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  
+  glGenFramebuffers(1, &_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  
+  // Renderbuffers rather than textures: nothing samples from them.
+  glGenRenderbuffers(2, _renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[0]);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples, GL_RGBA8, _width,
+    _height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+    _renderbuffers[0]);
+  glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[1]);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples,
+    GL_DEPTH_COMPONENT24, _width, _height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+    _renderbuffers[1]);
+  
+  try {
+    check(GL_FRAMEBUFFER);
+  
+    if (_samples > 0) {
+      glGenFramebuffers(1, &_resolveFramebuffer);
+      glBindFramebuffer(GL_FRAMEBUFFER, _resolveFramebuffer);
+      glGenRenderbuffers(1, &_resolveColor);
+      glBindRenderbuffer(GL_RENDERBUFFER, _resolveColor);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, _resolveColor);
+      check(GL_FRAMEBUFFER);
+    }
+  }
+  catch (...) {
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    glDeleteRenderbuffers(1, &_resolveColor);
+    glDeleteFramebuffers(1, &_resolveFramebuffer);
+    glDeleteRenderbuffers(2, _renderbuffers);
+    glDeleteFramebuffers(1, &_framebuffer);
+    throw;
+  }
+  
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+Framebuffer::~Framebuffer() {
+  glDeleteRenderbuffers(1, &_resolveColor);
+  glDeleteFramebuffers(1, &_resolveFramebuffer);
+  glDeleteRenderbuffers(2, _renderbuffers);
+  glDeleteFramebuffers(1, &_framebuffer);
+}
+
+void Framebuffer::bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  glViewport(0, 0, _width, _height);
+}
+
+void Framebuffer::resolve() const {
+  if (_samples == 0) {
+    return;
+  }
+  
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _resolveFramebuffer);
+  glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height,
+    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+}
+
+void Framebuffer::readPixels(vector<unsigned char>& pixels) const {
+  pixels.resize((size_t)_width * _height * 4);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER,
+    _samples > 0 ? _resolveFramebuffer : _framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+}
+
+int Framebuffer::width() const {
+  return _width;
+}
+
+int Framebuffer::height() const {
+  return _height;
+}
+
+int Framebuffer::samples() const {
+  return _samples;
+}
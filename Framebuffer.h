@@ -0,0 +1,62 @@
+#ifndef _FRAMEBUFFER_H_
+#define _FRAMEBUFFER_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include "Exceptions.h"
+
+/**
+ * An offscreen render target with an RGBA8 color buffer and a depth buffer, for
+ * rendering without a visible window. If it is multisampled, resolve() copies the
+ * samples into a single-sampled buffer that readPixels() reads from.
+ */
+class Framebuffer {
+  int _width;
+  int _height;
+  int _samples;
+  GLuint _framebuffer;
+  GLuint _renderbuffers[2];
+  // Only used when multisampled.
+  GLuint _resolveFramebuffer;
+  GLuint _resolveColor;
+
+  Framebuffer(const Framebuffer&);
+  Framebuffer& operator=(const Framebuffer&);
+
+  static void check(GLenum target);
+
+public:
+  /**
+   * Creates the framebuffer and its buffers. The previous framebuffer binding is
+   * restored afterwards.
+   * @param width the width, in pixels
+   * @param height the height, in pixels
+   * @param samples the number of samples per pixel; 0 for no multisampling
+   * @throws FramebufferError if the driver cannot render into this combination
+   */
+  Framebuffer(int width, int height, int samples = 0);
+  ~Framebuffer();
+
+  /**
+   * Binds the framebuffer for drawing and reading and sets the viewport to cover it.
+   */
+  void bind() const;
+
+  /**
+   * Makes the latest rendering available to readPixels(). Does nothing unless the
+   * framebuffer is multisampled. Leaves the framebuffer bound.
+   */
+  void resolve() const;
+
+  /**
+   * Reads back the color buffer as RGBA8, bottom row first. Call resolve() first.
+   * @param pixels receives width() * height() * 4 bytes
+   */
+  void readPixels(std::vector<unsigned char>& pixels) const;
+
+  int width() const;
+  int height() const;
+  int samples() const;
+};
+
+#endif
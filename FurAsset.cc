@@ -0,0 +1,255 @@
+#include "FurAsset.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include "Exceptions.h"
+
+using namespace std;
+
+// Sections are aligned so that the buffers handed to OpenGL are too.
+static const uint64_t SECTION_ALIGNMENT = 64;
+// Larger than any OpenGL implementation's GL_MAX_TEXTURE_SIZE, and small enough
+// that texture sizes cannot overflow.
+static const uint32_t MAX_TEXTURE_SIZE = 1 << 16;
+
+enum Section {
+  ATTRIBUTES,
+  POSITIONS,
+  INDICES,
+  FUR_PIXELS,
+  COLOR_PIXELS,
+  SECTIONS
+};
+
+/**
+ * The start of an asset file. Sections follow, in the order of Section.
+ */
+struct AssetHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t shellMode;
+  uint32_t layers;
+  float maxHairLength;
+  uint32_t texCoords;
+  uint32_t packed;
+  uint32_t splitPositions;
+  float boundsLower[3];
+  float boundsUpper[3];
+  uint32_t indexType;
+  uint32_t count;
+  uint32_t furWidth;
+  uint32_t furHeight;
+  uint32_t furFormat;
+  uint32_t colorWidth;
+  uint32_t colorHeight;
+  uint32_t colorChannels;
+  uint32_t flat;
+  float origin[3];
+  float uAxis[3];
+  float vAxis[3];
+  uint64_t offsets[SECTIONS];
+  uint64_t sizes[SECTIONS];
+};
+
+static const char MAGIC[4] = { 'F', 'U', 'R', 'A' };
+
+static void copyVec3(const glm::vec3& v, float out[3]) {
+  out[0] = v.x;
+  out[1] = v.y;
+  out[2] = v.z;
+}
+
+static glm::vec3 toVec3(const float v[3]) {
+  return glm::vec3(v[0], v[1], v[2]);
+}
+
+/**
+ * Returns the largest of a number of indices, or 0 if there are none.
+ */
+template <typename Index>
+static size_t maxIndex(const void* indices, size_t count) {
+  const Index* begin = (const Index*)indices;
+  return count > 0 ? *max_element(begin, begin + count) : 0;
+}
+
+FurAsset::FurAsset(const char* fileName)
+  : _file(make_shared<MappedFile>(fileName)) {
+  const string name(fileName);
+  AssetHeader header;
+  if (_file->size() < sizeof(header)) {
+    throw AssetError(name + " is too short to be a fur asset");
+  }
+  memcpy(&header, _file->data(), sizeof(header));
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw AssetError(name + " is not a fur asset");
+  }
+  if (header.version != FORMAT_VERSION || header.headerSize != sizeof(header)) {
+    throw AssetError(name + " has an unsupported fur asset version; bake it again");
+  }
+  
+  // Enumerations and sizes have to be checked before anything is derived from
+  // them.
+  if (header.shellMode > FurGeometry::GEOMETRY_SHELLS ||
+      header.texCoords > FurVertexFormat::UNORM16_TEXCOORDS ||
+      header.furFormat > FurTexture::R8 || header.layers == 0 ||
+      header.layers > INT_MAX || header.count == 0 || header.count > INT_MAX ||
+      (header.shellMode == FurGeometry::GEOMETRY_SHELLS &&
+       header.layers > FurGeometry::MAX_GEOMETRY_SHELLS) ||
+      (header.shellMode == FurGeometry::BAKED_SHELLS &&
+       header.count % header.layers != 0) ||
+      (header.indexType != GL_NONE && header.indexType != GL_UNSIGNED_SHORT &&
+       header.indexType != GL_UNSIGNED_INT) ||
+      header.furWidth == 0 || header.furWidth > MAX_TEXTURE_SIZE ||
+      header.furHeight == 0 || header.furHeight > MAX_TEXTURE_SIZE ||
+      header.colorWidth == 0 || header.colorWidth > MAX_TEXTURE_SIZE ||
+      header.colorHeight == 0 || header.colorHeight > MAX_TEXTURE_SIZE ||
+      (header.colorChannels != 3 && header.colorChannels != 4)) {
+    throw AssetError(name + " has an invalid header");
+  }
+  for (int i = 0; i < SECTIONS; i++) {
+    if (header.offsets[i] % SECTION_ALIGNMENT != 0 ||
+        header.offsets[i] > _file->size() ||
+        header.sizes[i] > _file->size() - header.offsets[i]) {
+      throw AssetError(name + " is truncated");
+    }
+  }
+  
+  Contents& c = _contents;
+  FurGeometry::Baked& g = c.geometry;
+  g.mode = (FurGeometry::ShellMode)header.shellMode;
+  g.layers = (int)header.layers;
+  g.maxHairLength = header.maxHairLength;
+  g.format = FurVertexFormat((FurVertexFormat::TexCoords)header.texCoords,
+    header.packed != 0, header.splitPositions != 0);
+  g.bounds.lower = toVec3(header.boundsLower);
+  g.bounds.upper = toVec3(header.boundsUpper);
+  g.indexType = header.indexType;
+  g.count = (int)header.count;
+  c.furWidth = (int)header.furWidth;
+  c.furHeight = (int)header.furHeight;
+  c.furFormat = (FurTexture::Format)header.furFormat;
+  c.colorWidth = (int)header.colorWidth;
+  c.colorHeight = (int)header.colorHeight;
+  c.colorChannels = (int)header.colorChannels;
+  c.flat = header.flat != 0;
+  c.origin = toVec3(header.origin);
+  c.uAxis = toVec3(header.uAxis);
+  c.vAxis = toVec3(header.vAxis);
+  
+  const unsigned char* data = _file->data();
+  g.attributes = data + header.offsets[ATTRIBUTES];
+  g.attributeBytes = (size_t)header.sizes[ATTRIBUTES];
+  g.positions = g.format.splitPositions ? data + header.offsets[POSITIONS] : NULL;
+  g.positionBytes = (size_t)header.sizes[POSITIONS];
+  g.indices = (g.indexType != GL_NONE) ? data + header.offsets[INDICES] : NULL;
+  g.indexBytes = (size_t)header.sizes[INDICES];
+  c.furPixels = data + header.offsets[FUR_PIXELS];
+  c.colorPixels = data + header.offsets[COLOR_PIXELS];
+  
+  // The sections have to hold exactly what the header describes, or OpenGL would
+  // read past them.
+  const bool baked = (g.mode == FurGeometry::BAKED_SHELLS);
+  const size_t positionSize = 3 * sizeof(GLfloat);
+  const size_t stride =
+    g.format.vertexSize(baked) - (g.format.splitPositions ? positionSize : 0);
+  const size_t vertices = g.attributeBytes / stride;
+  const size_t indexSize =
+    (g.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+  const size_t furBytes =
+    (c.furFormat == FurTexture::R8) ? 1 : sizeof(RGBColor);
+  if (vertices == 0 || g.attributeBytes != vertices * stride ||
+      g.positionBytes != (g.format.splitPositions ? vertices * positionSize : 0) ||
+      g.indexBytes != (g.indices ? (size_t)g.count * indexSize : 0) ||
+      (!g.indices && (size_t)g.count != vertices) ||
+      header.sizes[FUR_PIXELS] != (uint64_t)c.furWidth * c.furHeight * furBytes ||
+      header.sizes[COLOR_PIXELS] !=
+        (uint64_t)c.colorWidth * c.colorHeight * c.colorChannels) {
+    throw AssetError(name + " has sections that do not match its header");
+  }
+  
+  // An index past the vertices would make OpenGL read outside the buffer.
+  if (g.indices) {
+    size_t largest = (g.indexType == GL_UNSIGNED_SHORT) ?
+      maxIndex<GLushort>(g.indices, g.count) : maxIndex<GLuint>(g.indices, g.count);
+    if (largest >= vertices) {
+      throw AssetError(name + " has indices past its vertices");
+    }
+  }
+}
+
+const FurAsset::Contents& FurAsset::contents() const {
+  return _contents;
+}
+
+shared_ptr<const void> FurAsset::owner() const {
+  return _file;
+}
+
+void FurAsset::write(const char* fileName, const Contents& contents) {
+  const FurGeometry::Baked& g = contents.geometry;
+  const size_t furBytes =
+    (contents.furFormat == FurTexture::R8) ? 1 : sizeof(RGBColor);
+  const void* sections[SECTIONS] = {
+    g.attributes, g.positions, g.indices, contents.furPixels, contents.colorPixels
+  };
+  const size_t sizes[SECTIONS] = {
+    g.attributeBytes,
+    g.positions ? g.positionBytes : 0,
+    g.indices ? g.indexBytes : 0,
+    (size_t)contents.furWidth * contents.furHeight * furBytes,
+    (size_t)contents.colorWidth * contents.colorHeight * contents.colorChannels
+  };
+  
+  AssetHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.headerSize = sizeof(header);
+  header.shellMode = g.mode;
+  header.layers = g.layers;
+  header.maxHairLength = g.maxHairLength;
+  header.texCoords = g.format.texCoords;
+  header.packed = g.format.packed;
+  header.splitPositions = g.format.splitPositions;
+  copyVec3(g.bounds.lower, header.boundsLower);
+  copyVec3(g.bounds.upper, header.boundsUpper);
+  header.indexType = g.indices ? g.indexType : GL_NONE;
+  header.count = g.count;
+  header.furWidth = contents.furWidth;
+  header.furHeight = contents.furHeight;
+  header.furFormat = contents.furFormat;
+  header.colorWidth = contents.colorWidth;
+  header.colorHeight = contents.colorHeight;
+  header.colorChannels = contents.colorChannels;
+  header.flat = contents.flat;
+  copyVec3(contents.origin, header.origin);
+  copyVec3(contents.uAxis, header.uAxis);
+  copyVec3(contents.vAxis, header.vAxis);
+  
+  uint64_t offset = sizeof(header);
+  for (int i = 0; i < SECTIONS; i++) {
+    offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    header.offsets[i] = offset;
+    header.sizes[i] = sizes[i];
+    offset += sizes[i];
+  }
+  
+  ofstream file(fileName, ios::binary | ios::trunc);
+  file.write((const char*)&header, sizeof(header));
+  uint64_t written = sizeof(header);
+  const char padding[SECTION_ALIGNMENT] = {};
+  for (int i = 0; i < SECTIONS; i++) {
+    file.write(padding, header.offsets[i] - written);
+    if (sizes[i] > 0) {
+      file.write((const char*)sections[i], sizes[i]);
+    }
+    written = header.offsets[i] + sizes[i];
+  }
+  file.close();
+  if (file.fail()) {
+    remove(fileName);
+    throw IOError(string("Could not write ") + fileName);
+  }
+}
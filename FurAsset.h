@@ -0,0 +1,87 @@
+#ifndef _FURASSET_H_
+#define _FURASSET_H_
+
+#include <cstdint>
+#include <memory>
+#include <glm/glm.hpp>
+#include "FurGeometry.h"
+#include "FurTexture.h"
+#include "MappedFile.h"
+
+/**
+ * A fur patch preprocessed into the layouts OpenGL takes: the baked vertex and
+ * index buffers, the strand map and the decoded color image. Loading maps the file
+ * and hands pointers into the mapping straight to glBufferData() and
+ * glTexImage2D(), so nothing is generated, decoded or copied on the CPU.
+ *
+ * Files are written by the furbake tool with write(). They store the host's byte
+ * order and are rejected unless their version is FORMAT_VERSION.
+ */
+class FurAsset {
+public:
+  static const uint32_t FORMAT_VERSION = 1;
+
+  /**
+   * Everything an asset holds. When loaded, the pointers lead into the mapped
+   * file, which owner() keeps alive.
+   */
+  struct Contents {
+    FurGeometry::Baked geometry;
+    int furWidth;
+    int furHeight;
+    FurTexture::Format furFormat;
+    const unsigned char* furPixels;
+    int colorWidth;
+    int colorHeight;
+    int colorChannels; // 3 or 4.
+    const unsigned char* colorPixels; // Bottom row first, as PNGImage holds them.
+    // Whether the patch is flat, i.e. a deformation map can cover it. The texel
+    // at (u, v) then lies at origin + u * uAxis + v * vAxis.
+    bool flat;
+    glm::vec3 origin;
+    glm::vec3 uAxis;
+    glm::vec3 vAxis;
+  };
+
+private:
+  std::shared_ptr<MappedFile> _file;
+  Contents _contents;
+
+  FurAsset(const FurAsset&);
+  FurAsset& operator=(const FurAsset&);
+
+public:
+  /**
+   * Maps an asset and checks it: the header has to describe geometry FurGeometry
+   * can draw, every section has to lie within the file and have the size the
+   * header implies, and every index has to lie within the vertices. Vertex
+   * attributes and pixels are not checked; a damaged one only draws wrong.
+   * @param fileName the path to the asset
+   * @throws IOError if the file could not be read
+   * @throws AssetError if the file is not an asset of this version or is damaged
+   */
+  explicit FurAsset(const char* fileName);
+
+  /**
+   * Returns what the asset holds.
+   * @return the contents, pointing into the mapped file
+   */
+  const Contents& contents() const;
+
+  /**
+   * Returns the mapping the contents point into, e.g. to keep it alive while a
+   * TextureStreamer uploads from it.
+   * @return the mapped file
+   */
+  std::shared_ptr<const void> owner() const;
+
+  /**
+   * Writes an asset.
+   * @param fileName the path to write to
+   * @param contents what to store
+   * @throws IOError if the file could not be written
+   */
+  static void write(const char* fileName, const Contents& contents);
+};
+
+#endif
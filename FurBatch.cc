@@ -0,0 +1,359 @@
+#include "FurBatch.h"
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+namespace {
+  const char* CULL_SHADER = "cull.comp";
+  const int CULL_GROUP_SIZE = 64;
+  
+  /**
+   * A FurBounds as cull.comp reads it.
+   */
+  struct PaddedBounds {
+    glm::vec4 lower;
+    glm::vec4 upper;
+  };
+}
+
+FurBatch::FurBatch(ShaderProgram& prog, int textureUnit, bool multiDraw) :
+  _textureUnit(textureUnit), _geometryDirty(false), _dirtyBegin(0),
+  _dirtyEnd(0) {
+  // Indirect commands need a base instance to find their patch ids.
+  _multiDraw = multiDraw && (GLEW_VERSION_4_3 ||
+    (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance));
+  _patchAttribute = prog.getAttribute("patchIndex");
+  
+  glGenBuffers(1, &_vertexBuffer);
+  glGenBuffers(1, &_elementBuffer);
+  glGenBuffers(1, &_patchIdBuffer);
+  glGenBuffers(1, &_indirectBuffer);
+  glGenBuffers(1, &_patchBuffer);
+  glGenBuffers(1, &_boundsBuffer);
+  
+  // The buffer object only exists once it has been bound.
+  glBindBuffer(GL_TEXTURE_BUFFER, _patchBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  
+  glGenTextures(1, &_patchTexture);
+  glBindTexture(GL_TEXTURE_BUFFER, _patchTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _patchBuffer);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  prog.use();
+  glUniform1i(prog.getUniform("patches"), textureUnit);
+  glUseProgram(previousProgram);
+  
+  // The compute pass writes straight into the indirect commands.
+  if (_multiDraw && GLEW_VERSION_4_3) {
+    ComputeShader cs(CULL_SHADER);
+    try {
+      _cullProgram.reset(new ShaderProgram(cs));
+    }
+    catch (...) {
+      cs.destroy();
+      throw;
+    }
+    cs.destroy();
+  }
+  
+  // Initialize vertex array.
+  glGenVertexArrays(1, &_vao);
+  glBindVertexArray(_vao);
+  
+  glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+  
+  GLint posAttribute = prog.getAttribute("pos");
+  glVertexAttribPointer(posAttribute, 3, GL_FLOAT, GL_FALSE,
+    sizeof(struct FurAttributes),
+    (void*)offsetof(struct FurAttributes, xyzPosition));
+  glEnableVertexAttribArray(posAttribute);
+  
+  GLint textureAttribute = prog.getAttribute("texCoord");
+  glVertexAttribPointer(textureAttribute, 2, GL_FLOAT, GL_FALSE,
+    sizeof(struct FurAttributes),
+    (void*)offsetof(struct FurAttributes, uvTexCoord));
+  glEnableVertexAttribArray(textureAttribute);
+  
+  GLint normAttribute = prog.getAttribute("norm");
+  glVertexAttribPointer(normAttribute, 3, GL_FLOAT, GL_FALSE,
+    sizeof(struct FurAttributes),
+    (void*)offsetof(struct FurAttributes, xyzNormal));
+  glEnableVertexAttribArray(normAttribute);
+  
+  if (_multiDraw) {
+    // One patch id per instance; each command's base instance skips to its patch.
+    glBindBuffer(GL_ARRAY_BUFFER, _patchIdBuffer);
+    glVertexAttribIPointer(_patchAttribute, 1, GL_INT, sizeof(GLint), (void*)0);
+    glVertexAttribDivisor(_patchAttribute, 1);
+    glEnableVertexAttribArray(_patchAttribute);
+  }
+  
+  // The element buffer binding is part of the VAO state.
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elementBuffer);
+  
+  // Rebind the default state.
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+FurBatch::~FurBatch() {
+  glDeleteVertexArrays(1, &_vao);
+  glDeleteTextures(1, &_patchTexture);
+  
+  GLuint buffers[] = {
+    _vertexBuffer, _elementBuffer, _patchIdBuffer, _indirectBuffer, _patchBuffer,
+    _boundsBuffer
+  };
+  glDeleteBuffers(6, buffers);
+  
+  if (_cullProgram) {
+    _cullProgram->destroy();
+  }
+}
+
+int FurBatch::add(const vector<FurAttributes>& vertices,
+  const vector<GLuint>& indices, int layers, float maxHairLength,
+  const glm::mat4& modelView) {
+  DrawCommand command;
+  command.count = (GLuint)indices.size();
+  command.instanceCount = (GLuint)layers;
+  command.firstIndex = (GLuint)_indices.size();
+  command.baseVertex = (GLint)_vertices.size();
+  command.baseInstance = _commands.empty() ? 0 :
+    _commands.back().baseInstance + _commands.back().instanceCount;
+  _commands.push_back(command);
+  _visibleCommands.push_back(command);
+  _bounds.push_back(FurBounds::of(vertices, maxHairLength));
+  
+  _vertices.insert(_vertices.end(), vertices.begin(), vertices.end());
+  _indices.insert(_indices.end(), indices.begin(), indices.end());
+  
+  FurPatchUniforms patch = FurPatchUniforms();
+  patch.modelView = modelView;
+  patch.displacement = glm::vec3(0.0f);
+  patch.shellHeight = maxHairLength;
+  patch.shellCount = (GLfloat)layers;
+  patch.drawnShells = (GLfloat)layers;
+  _patches.push_back(patch);
+  
+  _geometryDirty = true;
+  return (int)_patches.size() - 1;
+}
+
+int FurBatch::patches() const {
+  return (int)_patches.size();
+}
+
+bool FurBatch::multiDraw() const {
+  return _multiDraw;
+}
+
+bool FurBatch::gpuCulling() const {
+  return _cullProgram != NULL;
+}
+
+const FurBounds& FurBatch::bounds(int patch) const {
+  return _bounds[patch];
+}
+
+void FurBatch::markDirty(int patch) {
+  if (_dirtyBegin == _dirtyEnd) {
+    _dirtyBegin = patch;
+    _dirtyEnd = patch + 1;
+  }
+  else {
+    _dirtyBegin = min(_dirtyBegin, patch);
+    _dirtyEnd = max(_dirtyEnd, patch + 1);
+  }
+}
+
+void FurBatch::setTransform(int patch, const glm::mat4& modelView) {
+  _patches[patch].modelView = modelView;
+  markDirty(patch);
+}
+
+void FurBatch::setDisplacement(int patch, const glm::vec3& displacement) {
+  _patches[patch].displacement = displacement;
+  markDirty(patch);
+}
+
+void FurBatch::uploadGeometry() {
+  glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(FurAttributes) * _vertices.size(),
+    _vertices.data(), GL_STATIC_DRAW);
+  
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elementBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * _indices.size(),
+    _indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  
+  if (_multiDraw) {
+    vector<GLint> patchIds;
+    for (size_t i = 0; i < _commands.size(); i++) {
+      patchIds.insert(patchIds.end(), _commands[i].instanceCount, (GLint)i);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, _patchIdBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLint) * patchIds.size(),
+      patchIds.data(), GL_STATIC_DRAW);
+  
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * _commands.size(),
+      _commands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  _visibleCommands = _commands;
+  
+  if (_cullProgram) {
+    vector<PaddedBounds> bounds(_bounds.size());
+    for (size_t i = 0; i < _bounds.size(); i++) {
+      bounds[i].lower = glm::vec4(_bounds[i].lower, 0.0f);
+      bounds[i].upper = glm::vec4(_bounds[i].upper, 0.0f);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _boundsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PaddedBounds) * bounds.size(),
+      bounds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  
+  // The patch buffer is reallocated to fit, so every patch has to be uploaded.
+  glBindBuffer(GL_TEXTURE_BUFFER, _patchBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(FurPatchUniforms) * _patches.size(),
+    NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  _dirtyBegin = 0;
+  _dirtyEnd = (int)_patches.size();
+  
+  _geometryDirty = false;
+}
+
+void FurBatch::uploadPatches() {
+  glBindBuffer(GL_TEXTURE_BUFFER, _patchBuffer);
+  glBufferSubData(GL_TEXTURE_BUFFER, sizeof(FurPatchUniforms) * _dirtyBegin,
+    sizeof(FurPatchUniforms) * (_dirtyEnd - _dirtyBegin), &_patches[_dirtyBegin]);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  
+  _dirtyBegin = _dirtyEnd = 0;
+}
+
+void FurBatch::sync() {
+  if (_geometryDirty) {
+    uploadGeometry();
+  }
+  if (_dirtyBegin != _dirtyEnd) {
+    uploadPatches();
+  }
+}
+
+void FurBatch::cullOnGpu(const glm::mat4& projection, float maxDisplacement,
+  float maxDistance, int viewportHeight, const FurLod& lod) {
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  _cullProgram->use();
+  
+  glUniformMatrix4fv(_cullProgram->getUniform("projection"), 1, GL_FALSE,
+    glm::value_ptr(projection));
+  glUniform1f(_cullProgram->getUniform("maxDisplacement"), maxDisplacement);
+  glUniform1f(_cullProgram->getUniform("maxDistance"), maxDistance);
+  glUniform1i(_cullProgram->getUniform("patchCount"), (GLint)_patches.size());
+  glUniform1i(_cullProgram->getUniform("viewportHeight"), viewportHeight);
+  glUniform1f(_cullProgram->getUniform("fullDetailPixels"),
+    lod.fullDetailPixels());
+  glUniform1i(_cullProgram->getUniform("minLayers"), lod.minLayers());
+  
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _patchBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _boundsBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _indirectBuffer);
+  
+  GLuint groups = (GLuint)((_patches.size() + CULL_GROUP_SIZE - 1) /
+    CULL_GROUP_SIZE);
+  glDispatchCompute(groups, 1, 1);
+  
+  // The next draw reads the commands as indirect arguments, and the shell counts
+  // through the patch texture.
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+  glUseProgram(previousProgram);
+}
+
+void FurBatch::cull(const glm::mat4& projection, float maxDisplacement,
+  float maxDistance, int viewportHeight, const FurLod& lod) {
+  if (_patches.empty()) {
+    return;
+  }
+  
+  sync();
+  
+  if (_cullProgram) {
+    cullOnGpu(projection, maxDisplacement, maxDistance, viewportHeight, lod);
+    return;
+  }
+  
+  for (size_t i = 0; i < _patches.size(); i++) {
+    FurPatchUniforms& patch = _patches[i];
+    float margin = maxDisplacement + glm::length(patch.displacement);
+    if (!_bounds[i].visible(projection, patch.modelView, margin, maxDistance)) {
+      _visibleCommands[i].instanceCount = 0;
+      continue;
+    }
+    
+    float pixels = FurLod::screenSize(_bounds[i], projection, patch.modelView,
+      viewportHeight);
+    int layers = lod.layers(_commands[i].instanceCount, pixels);
+    _visibleCommands[i].instanceCount = layers;
+    if (patch.drawnShells != (GLfloat)layers) {
+      patch.drawnShells = (GLfloat)layers;
+      markDirty((int)i);
+    }
+  }
+  
+  // Upload any changed shell counts.
+  if (_dirtyBegin != _dirtyEnd) {
+    uploadPatches();
+  }
+  
+  if (_multiDraw) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0,
+      sizeof(DrawCommand) * _visibleCommands.size(), _visibleCommands.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+}
+
+void FurBatch::draw() {
+  if (_patches.empty()) {
+    return;
+  }
+  
+  sync();
+  
+  glActiveTexture(GL_TEXTURE0 + _textureUnit);
+  glBindTexture(GL_TEXTURE_BUFFER, _patchTexture);
+  glBindVertexArray(_vao);
+  
+  if (_multiDraw) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0,
+      (GLsizei)_commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  else {
+    // Without base instances, the patch id is a constant attribute per draw.
+    for (size_t i = 0; i < _visibleCommands.size(); i++) {
+      const DrawCommand& command = _visibleCommands[i];
+      if (command.instanceCount == 0) {
+        continue;
+      }
+      glVertexAttribI1i(_patchAttribute, (GLint)i);
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count,
+        GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * command.firstIndex),
+        command.instanceCount, command.baseVertex);
+    }
+  }
+  
+  glBindVertexArray(0);
+}
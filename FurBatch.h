@@ -0,0 +1,176 @@
+#ifndef _FURBATCH_H_
+#define _FURBATCH_H_
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "FurGeometry.h"
+#include "ShaderProgram.h"
+
+/**
+ * The per-patch data read by batch.vert, one texel per vec4.
+ */
+struct FurPatchUniforms {
+  glm::mat4 modelView;
+  glm::vec3 displacement;
+  GLfloat shellHeight;
+  GLfloat shellCount;
+  GLfloat drawnShells;
+  GLfloat padding[2];
+};
+
+/**
+ * Many fur patches packed into one vertex buffer and one index buffer, and drawn
+ * with a single submission. Each patch is drawn like INSTANCED_SHELLS geometry,
+ * with one instance per shell.
+ *
+ * Per-patch transforms and displacements live in a texture buffer that the vertex
+ * shader indexes with a per-instance patch attribute. On GL 4.3 the draws are
+ * submitted with one glMultiDrawElementsIndirect call; on GL 3.3 the batch still
+ * shares its buffers and its VAO, but issues one draw per patch.
+ *
+ * cull() drops the patches that are outside the view frustum or too far away, and
+ * picks the number of shells for the rest (see FurLod). On GL 4.3 a compute pass
+ * writes the instance counts of the indirect commands directly; otherwise the
+ * patches are tested on the CPU.
+ */
+class FurBatch {
+public:
+  /**
+   * The layout of one indirect draw, as GL_DRAW_INDIRECT_BUFFER expects it.
+   */
+  struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+private:
+  std::vector<FurAttributes> _vertices;
+  std::vector<GLuint> _indices;
+  std::vector<DrawCommand> _commands;
+  std::vector<DrawCommand> _visibleCommands;
+  std::vector<FurPatchUniforms> _patches;
+  std::vector<FurBounds> _bounds;
+  GLuint _vao;
+  GLuint _vertexBuffer;
+  GLuint _elementBuffer;
+  GLuint _patchIdBuffer;
+  GLuint _indirectBuffer;
+  GLuint _patchBuffer;
+  GLuint _patchTexture;
+  GLuint _boundsBuffer;
+  GLint _patchAttribute;
+  std::unique_ptr<ShaderProgram> _cullProgram;
+  int _textureUnit;
+  bool _multiDraw;
+  bool _geometryDirty;
+  int _dirtyBegin;
+  int _dirtyEnd;
+
+  FurBatch(const FurBatch&);
+  FurBatch& operator=(const FurBatch&);
+
+  void uploadGeometry();
+  void uploadPatches();
+  void markDirty(int patch);
+  void sync();
+  void cullOnGpu(const glm::mat4& projection, float maxDisplacement,
+    float maxDistance, int viewportHeight, const FurLod& lod);
+
+public:
+  /**
+   * Creates an empty batch.
+   * @param prog the shader program the batch will be drawn with (see batch.vert)
+   * @param textureUnit the texture unit to bind the per-patch data to
+   * @param multiDraw whether to use indirect multi-draw if the context supports it
+   * @throws ifstream::failure if GPU culling is supported but cull.comp could not be
+   *         read
+   * @throws GLSLError if cull.comp could not be compiled
+   */
+  FurBatch(ShaderProgram& prog, int textureUnit, bool multiDraw = true);
+
+  /**
+   * Deletes all buffers.
+   */
+  ~FurBatch();
+
+  /**
+   * Adds a patch. Its base mesh is appended to the shared buffers the next time the
+   * batch is drawn.
+   * @param vertices the base mesh vertices
+   * @param indices three indices into vertices per triangle
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param modelView the initial model-view matrix of the patch
+   * @return the index of the patch
+   */
+  int add(const std::vector<FurAttributes>& vertices,
+    const std::vector<GLuint>& indices, int layers, float maxHairLength,
+    const glm::mat4& modelView);
+
+  /**
+   * Returns the number of patches.
+   * @return the number of patches
+   */
+  int patches() const;
+
+  /**
+   * Indicates whether draw() submits everything with one indirect multi-draw.
+   * @return whether indirect multi-draw is used
+   */
+  bool multiDraw() const;
+
+  /**
+   * Indicates whether cull() runs on the GPU.
+   * @return whether culling uses a compute pass
+   */
+  bool gpuCulling() const;
+
+  /**
+   * Returns the box around a patch and all of its shells.
+   * @param patch the index returned by add()
+   * @return the bounds in model space
+   */
+  const FurBounds& bounds(int patch) const;
+
+  /**
+   * Changes the model-view matrix of a patch.
+   * @param patch the index returned by add()
+   * @param modelView the new model-view matrix
+   */
+  void setTransform(int patch, const glm::mat4& modelView);
+
+  /**
+   * Changes the displacement of a patch, added to the per-frame displacement.
+   * @param patch the index returned by add()
+   * @param displacement the new displacement
+   */
+  void setDisplacement(int patch, const glm::vec3& displacement);
+
+  /**
+   * Decides which patches the following draw() calls submit. Without a call to
+   * cull(), every patch is drawn; the result of a call lasts until the next one.
+   * Call it after this frame's setTransform() and setDisplacement() calls.
+   * Uses the same test as FurBounds::visible().
+   * @param projection the projection matrix
+   * @param maxDisplacement the length of the per-frame displacement; each patch's
+   *                        own displacement is added to it
+   * @param maxDistance patches further than this from the eye are not drawn
+   * @param viewportHeight the height of the viewport, in pixels
+   * @param lod how many shells to draw for the patches that are drawn
+   */
+  void cull(const glm::mat4& projection, float maxDisplacement,
+    float maxDistance, int viewportHeight = 0, const FurLod& lod = FurLod());
+
+  /**
+   * Draws every patch. The shader program given at construction must be in use,
+   * with its "Frame" block bound to FurGeometry::FRAME_BINDING. Only the patch
+   * data that changed since the last draw is uploaded.
+   */
+  void draw();
+};
+
+#endif
@@ -1,12 +1,169 @@
 #include "FurGeometry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
 
 using namespace std;
 
-GLuint FurGeometry::initVao(GLuint buffer, ShaderProgram prog) {
+FurVertexFormat::FurVertexFormat(TexCoords texCoords, bool packed,
+  bool splitPositions) :
+  texCoords(texCoords), packed(packed), splitPositions(splitPositions) {}
+
+FurVertexFormat FurVertexFormat::compact() {
+  return FurVertexFormat(HALF_TEXCOORDS, true);
+}
+
+namespace {
+  /**
+   * Where each attribute lies within a vertex of the attribute stream. Positions
+   * come first unless they have a stream of their own; the layer or normal comes
+   * last. Every attribute starts on a 4-byte boundary.
+   */
+  struct VertexLayout {
+    size_t stride;
+    size_t texCoordOffset;
+    size_t lastOffset;
+  
+    VertexLayout(const FurVertexFormat& format, bool baked) {
+      texCoordOffset = format.splitPositions ? 0 : 3 * sizeof(GLfloat);
+      lastOffset = texCoordOffset +
+        ((format.texCoords == FurVertexFormat::FLOAT_TEXCOORDS) ? 8 : 4);
+      size_t lastSize;
+      if (baked) {
+        // A 16-bit layer is padded to keep the stride a multiple of 4.
+        lastSize = 4;
+      }
+      else {
+        lastSize = format.packed ? 4 : 3 * sizeof(GLfloat);
+      }
+      stride = lastOffset + lastSize;
+    }
+  };
+}
+
+size_t FurVertexFormat::vertexSize(bool baked) const {
+  VertexLayout layout(*this, baked);
+  return layout.stride + (splitPositions ? 3 * sizeof(GLfloat) : 0);
+}
+
+/**
+ * Converts a float to an IEEE half float, rounding to nearest. Values too large
+ * for a half become infinity.
+ */
+static GLushort toHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+  uint32_t mantissa = bits & 0x7FFFFF;
+  
+  if (exponent <= 0) {
+    // Too small for a normal half: shift the implicit 1 into a subnormal.
+    if (exponent < -10) {
+      return (GLushort)sign;
+    }
+    mantissa |= 0x800000;
+    return (GLushort)(sign | ((mantissa >> (14 - exponent)) +
+      ((mantissa >> (13 - exponent)) & 1)));
+  }
+  if (exponent >= 31) {
+    return (GLushort)(sign | 0x7C00);
+  }
+  // A rounding carry out of the mantissa correctly bumps the exponent.
+  return (GLushort)((sign | (exponent << 10) | (mantissa >> 13)) +
+    ((mantissa >> 12) & 1));
+}
+
+static GLushort toUnorm16(float value) {
+  return (GLushort)(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static GLshort toSnorm16(float value) {
+  return (GLshort)floor(glm::clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+/**
+ * Maps a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds the
+ * lower half over the corners, giving two coordinates in [-1, 1].
+ */
+static void toOctahedral(const glm::vec3& n, GLshort out[2]) {
+  float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+  float x = (sum > 0.0f) ? n.x / sum : 0.0f;
+  float y = (sum > 0.0f) ? n.y / sum : 0.0f;
+  if (n.z < 0.0f) {
+    float foldedX = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float foldedY = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = foldedX;
+    y = foldedY;
+  }
+  out[0] = toSnorm16(x);
+  out[1] = toSnorm16(y);
+}
+
+/**
+ * Packs vertices into a position stream (if split) and an attribute stream, whose
+ * padding must already be zeroed. Baked shell vertices are extruded first.
+ * @param layer the layer of every vertex, for baked shells
+ * @param extrusion how far to extrude along the normals, for baked shells
+ * @param positions where the positions go, if the format splits them
+ * @param attributes where the attributes go
+ */
+static void encodeVertices(const vector<FurAttributes>& vertices,
+  const FurVertexFormat& format, bool baked, float layer, float extrusion,
+  unsigned char* positions, unsigned char* attributes) {
+  VertexLayout layout(format, baked);
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const FurAttributes& f = vertices[i];
+    unsigned char* vertex = attributes + i * layout.stride;
+    unsigned char* position = format.splitPositions ?
+      positions + i * 3 * sizeof(GLfloat) : vertex;
+    glm::vec3 p = baked ? f.xyzPosition + f.xyzNormal * extrusion : f.xyzPosition;
+    const GLfloat xyz[3] = { p.x, p.y, p.z };
+    memcpy(position, xyz, sizeof(xyz));
+  
+    unsigned char* texCoord = vertex + layout.texCoordOffset;
+    if (format.texCoords == FurVertexFormat::FLOAT_TEXCOORDS) {
+      const GLfloat uv[2] = { f.uvTexCoord.x, f.uvTexCoord.y };
+      memcpy(texCoord, uv, sizeof(uv));
+    }
+    else {
+      bool half = (format.texCoords == FurVertexFormat::HALF_TEXCOORDS);
+      const GLushort packed[2] = {
+        half ? toHalf(f.uvTexCoord.x) : toUnorm16(f.uvTexCoord.x),
+        half ? toHalf(f.uvTexCoord.y) : toUnorm16(f.uvTexCoord.y)
+      };
+      memcpy(texCoord, packed, sizeof(packed));
+    }
+  
+    unsigned char* last = vertex + layout.lastOffset;
+    if (baked && format.packed) {
+      GLushort packedLayer = toUnorm16(layer);
+      memcpy(last, &packedLayer, sizeof(packedLayer));
+    }
+    else if (baked) {
+      memcpy(last, &layer, sizeof(GLfloat));
+    }
+    else if (format.packed) {
+      GLshort normal[2];
+      toOctahedral(f.xyzNormal, normal);
+      memcpy(last, normal, sizeof(normal));
+    }
+    else {
+      const GLfloat normal[3] = { f.xyzNormal.x, f.xyzNormal.y, f.xyzNormal.z };
+      memcpy(last, normal, sizeof(normal));
+    }
+  }
+}
+
+GLuint FurGeometry::initVao(ShaderProgram& prog) {
   GLint posAttribute = prog.getAttribute("pos");
   GLint textureAttribute = prog.getAttribute("texCoord");
   GLint layerAttribute = prog.getAttribute("layer");
-  //GLint normAttribute = prog.getAttribute("norm");
+  GLint normAttribute = prog.getAttribute("norm");
+  const bool baked = (_mode == BAKED_SHELLS);
+  VertexLayout layout(_format, baked);
   
   // Initialize vertex array.
   GLuint array;
@@ -14,49 +171,50 @@ GLuint FurGeometry::initVao(GLuint buffer, ShaderProgram prog) {
   glBindVertexArray(array);
   
   // Configure attributes.
-  glBindBuffer(GL_ARRAY_BUFFER, array);
-  
-  glVertexAttribPointer(
-    posAttribute,
-    3,
-    GL_FLOAT,
-    GL_FALSE,
-    sizeof(struct FurAttributes),
-    (void*)offsetof(struct FurAttributes, xyzPosition)
-  );
+  if (_format.splitPositions) {
+    glBindBuffer(GL_ARRAY_BUFFER, _positionBuffer);
+    glVertexAttribPointer(posAttribute, 3, GL_FLOAT, GL_FALSE,
+      3 * sizeof(GLfloat), (void*)0);
+  }
+  else {
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    glVertexAttribPointer(posAttribute, 3, GL_FLOAT, GL_FALSE, layout.stride,
+      (void*)0);
+  }
   glEnableVertexAttribArray(posAttribute);
   
-  /*
-  glVertexAttribPointer(
-    normAttribute,
-    3,
-    GL_FLOAT,
-    GL_FALSE,
-    sizeof(struct FurAttributes),
-    (void*)offsetof(struct FurAttributes, xyzNormal)
-  );
-  glEnableVertexAttribArray(normAttribute);
-  */
-  
-  glVertexAttribPointer(
-    textureAttribute,
-    2,
-    GL_FLOAT,
-    GL_FALSE,
-    sizeof(struct FurAttributes),
-    (void*)offsetof(struct FurAttributes, uvTexCoord)
-  );
+  glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+  switch (_format.texCoords) {
+    case FurVertexFormat::FLOAT_TEXCOORDS:
+      glVertexAttribPointer(textureAttribute, 2, GL_FLOAT, GL_FALSE, layout.stride,
+        (void*)layout.texCoordOffset);
+      break;
+    case FurVertexFormat::HALF_TEXCOORDS:
+      glVertexAttribPointer(textureAttribute, 2, GL_HALF_FLOAT, GL_FALSE,
+        layout.stride, (void*)layout.texCoordOffset);
+      break;
+    case FurVertexFormat::UNORM16_TEXCOORDS:
+      glVertexAttribPointer(textureAttribute, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+        layout.stride, (void*)layout.texCoordOffset);
+      break;
+  }
   glEnableVertexAttribArray(textureAttribute);
   
-  glVertexAttribPointer(
-    layerAttribute,
-    1,
-    GL_FLOAT,
-    GL_FALSE,
-    sizeof(struct FurAttributes),
-    (void*)offsetof(struct FurAttributes, layer)
-  );
-  glEnableVertexAttribArray(layerAttribute);
+  if (baked) {
+    // Every vertex carries its own layer; the extrusion is already applied.
+    glVertexAttribPointer(layerAttribute, 1,
+      _format.packed ? GL_UNSIGNED_SHORT : GL_FLOAT, _format.packed, layout.stride,
+      (void*)layout.lastOffset);
+    glEnableVertexAttribArray(layerAttribute);
+  }
+  else {
+    // The vertex or geometry shader extrudes each shell along the normal. Packed
+    // normals arrive as (x, y, 0) and are unfolded by the shader.
+    glVertexAttribPointer(normAttribute, _format.packed ? 2 : 3,
+      _format.packed ? GL_SHORT : GL_FLOAT, _format.packed, layout.stride,
+      (void*)layout.lastOffset);
+    glEnableVertexAttribArray(normAttribute);
+  }
   
   // Rebind the default state.
   glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -64,34 +222,388 @@ GLuint FurGeometry::initVao(GLuint buffer, ShaderProgram prog) {
   
   return array;
 }
+
+/**
+ * Checks that a shell mode can draw a number of layers.
+ * @throws invalid_argument if it cannot
+ */
+static void checkLayers(int layers, FurGeometry::ShellMode mode) {
+  if (layers < 1) {
+    throw invalid_argument("Fur geometry needs at least one layer");
+  }
+  if (mode == FurGeometry::GEOMETRY_SHELLS &&
+      layers > FurGeometry::MAX_GEOMETRY_SHELLS) {
+    throw invalid_argument("Geometry-shader shells are limited to " +
+      to_string(FurGeometry::MAX_GEOMETRY_SHELLS) + " layers");
+  }
+}
+
+/**
+ * Repeats an index buffer once per baked shell, offsetting each copy to that
+ * shell's vertices.
+ */
+template <typename In, typename Out>
+static void bakeIndices(const vector<In>& indices, int layers, size_t vertexCount,
+  Out* out) {
+  for (int i = 0; i < layers; i++) {
+    Out offset = (Out)(i * vertexCount);
+    for (In index : indices) {
+      *out++ = offset + (Out)index;
+    }
+  }
+}
+  
+template <typename Index>
+FurGeometry::Baked FurGeometry::bakeMesh(const vector<FurAttributes>& vertices,
+  const vector<Index>* indices, GLenum indexType, int layers, int maxHairLength,
+  ShellMode mode, const FurVertexFormat& format, vector<unsigned char>& storage) {
+  checkLayers(layers, mode);
+  
+  Baked baked;
+  baked.mode = mode;
+  baked.layers = layers;
+  baked.maxHairLength = (float)maxHairLength;
+  baked.format = format;
+  baked.bounds = FurBounds::of(vertices, baked.maxHairLength);
+  
+  // Baked shells copy the base mesh once per layer; the other modes upload it
+  // once and leave the shells to the shaders.
+  const bool bakedShells = (mode == BAKED_SHELLS);
+  const int copies = bakedShells ? layers : 1;
+  const size_t vertexCount = vertices.size() * copies;
+  const size_t stride = VertexLayout(format, bakedShells).stride;
+  baked.attributeBytes = vertexCount * stride;
+  baked.positionBytes =
+    format.splitPositions ? vertexCount * 3 * sizeof(GLfloat) : 0;
+  
+  // Shell copies may no longer fit the caller's index type.
+  baked.indexType = indices ? indexType : 0;
+  if (indices && bakedShells && vertexCount > 0xFFFF) {
+    baked.indexType = GL_UNSIGNED_INT;
+  }
+  const size_t indexSize = (baked.indexType == GL_UNSIGNED_INT) ?
+    sizeof(GLuint) : sizeof(GLushort);
+  const size_t indexCount = indices ? indices->size() * copies : 0;
+  baked.indexBytes = indexCount * indexSize;
+  baked.count = (int)(indices ? indices->size() : vertices.size());
+  if (bakedShells) {
+    baked.count *= layers;
+  }
+
+  // One block holds every buffer; each starts 4-byte aligned.
+  storage.assign(baked.attributeBytes + baked.positionBytes + baked.indexBytes, 0);
+  unsigned char* attributes = storage.data();
+  unsigned char* positions = attributes + baked.attributeBytes;
+  unsigned char* indexData = positions + baked.positionBytes;
+  for (int i = 0; i < copies; i++) {
+    // A single layer is the base mesh, rather than 0 / 0.
+    float layer = bakedShells ? (float)i / (float)max(layers - 1, 1) : 0.0f;
+    size_t first = i * vertices.size();
+    encodeVertices(vertices, format, bakedShells, layer,
+      baked.maxHairLength * layer, positions + first * 3 * sizeof(GLfloat),
+      attributes + first * stride);
+  }
+  if (indices && baked.indexType == GL_UNSIGNED_INT) {
+    bakeIndices<Index, GLuint>(*indices, copies, vertices.size(),
+      (GLuint*)indexData);
+  }
+  else if (indices) {
+    bakeIndices<Index, Index>(*indices, copies, vertices.size(),
+      (Index*)indexData);
+  }
+  
+  baked.attributes = attributes;
+  baked.positions = format.splitPositions ? positions : NULL;
+  baked.indices = indices ? indexData : NULL;
+  return baked;
+}
+
+FurGeometry::Baked FurGeometry::bake(const vector<FurAttributes>& geom,
+  int layers, int maxHairLength, ShellMode mode, const FurVertexFormat& format,
+  vector<unsigned char>& storage) {
+  return bakeMesh<GLuint>(geom, NULL, 0, layers, maxHairLength, mode, format,
+    storage);
+}
+
+FurGeometry::Baked FurGeometry::bake(const vector<FurAttributes>& vertices,
+  const vector<GLushort>& indices, int layers, int maxHairLength, ShellMode mode,
+  const FurVertexFormat& format, vector<unsigned char>& storage) {
+  return bakeMesh(vertices, &indices, GL_UNSIGNED_SHORT, layers, maxHairLength,
+    mode, format, storage);
+}
+
+FurGeometry::Baked FurGeometry::bake(const vector<FurAttributes>& vertices,
+  const vector<GLuint>& indices, int layers, int maxHairLength, ShellMode mode,
+  const FurVertexFormat& format, vector<unsigned char>& storage) {
+  return bakeMesh(vertices, &indices, GL_UNSIGNED_INT, layers, maxHairLength,
+    mode, format, storage);
+}
+
+void FurGeometry::init(const Baked& baked, ShaderProgram& prog) {
+  _mode = baked.mode;
+  _layers = baked.layers;
+  _maxHairLength = baked.maxHairLength;
+  _format = baked.format;
+  _bounds = baked.bounds;
+  _indexType = baked.indexType;
+  _indices = baked.count;
   
+  glGenBuffers(1, &_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+  glBufferData(GL_ARRAY_BUFFER, baked.attributeBytes, baked.attributes,
+    GL_STATIC_DRAW);
+  
+  _positionBuffer = 0;
+  if (baked.positions) {
+    glGenBuffers(1, &_positionBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _positionBuffer);
+    glBufferData(GL_ARRAY_BUFFER, baked.positionBytes, baked.positions,
+      GL_STATIC_DRAW);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  
+  _vao = initVao(prog);
+  
+  // The element buffer binding is part of the VAO state.
+  _elementBuffer = 0;
+  if (baked.indices) {
+    glBindVertexArray(_vao);
+    glGenBuffers(1, &_elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, baked.indexBytes, baked.indices,
+      GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+}
+
+FurGeometry::FurGeometry(const Baked& baked, ShaderProgram& prog) {
+  init(baked, prog);
+}
+
 FurGeometry::FurGeometry(vector<FurAttributes>& geom, ShaderProgram& prog,
-  int layers, int maxHairLength) {
-  vector<FurAttributes> newGeom;
+  int layers, int maxHairLength, ShellMode mode, const FurVertexFormat& format) {
+  vector<unsigned char> storage;
+  init(bake(geom, layers, maxHairLength, mode, format, storage), prog);
+}
+
+FurGeometry::FurGeometry(const vector<FurAttributes>& vertices,
+  const vector<GLushort>& indices, ShaderProgram& prog,
+  int layers, int maxHairLength, ShellMode mode, const FurVertexFormat& format) {
+  vector<unsigned char> storage;
+  init(bake(vertices, indices, layers, maxHairLength, mode, format, storage),
+    prog);
+}
+
+FurGeometry::FurGeometry(const vector<FurAttributes>& vertices,
+  const vector<GLuint>& indices, ShaderProgram& prog,
+  int layers, int maxHairLength, ShellMode mode, const FurVertexFormat& format) {
+  vector<unsigned char> storage;
+  init(bake(vertices, indices, layers, maxHairLength, mode, format, storage),
+    prog);
+}
+
+namespace {
+  struct FurAttributesHash {
+    size_t operator()(const FurAttributes& f) const {
+      // FNV-1a over the raw attribute bytes.
+      const unsigned char* bytes = (const unsigned char*)&f;
+      size_t hash = 2166136261u;
+      for (size_t i = 0; i < sizeof(FurAttributes); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+      }
+      return hash;
+    }
+  };
   
-  for (int i = 0; i < layers; i++) {
-    float layer = (float)i/(float)(layers - 1);
-    float layerHairLength = maxHairLength * layer;
-    for (FurAttributes f : geom) {
-      f.xyzPosition = f.xyzPosition + f.xyzNormal * layerHairLength;
-      f.layer = layer;
-      newGeom.push_back(f);
+  struct FurAttributesEqual {
+    bool operator()(const FurAttributes& a, const FurAttributes& b) const {
+      return memcmp(&a, &b, sizeof(FurAttributes)) == 0;
+    }
+  };
+}
+
+void FurGeometry::weld(const vector<FurAttributes>& geom,
+  vector<FurAttributes>& outVertices, vector<GLuint>& outIndices) {
+  unordered_map<FurAttributes, GLuint, FurAttributesHash, FurAttributesEqual>
+    seen(geom.size());
+  
+  outVertices.clear();
+  outIndices.clear();
+  outIndices.reserve(geom.size());
+  
+  for (const FurAttributes& f : geom) {
+    auto found = seen.find(f);
+    if (found != seen.end()) {
+      outIndices.push_back(found->second);
+    }
+    else {
+      GLuint index = (GLuint)outVertices.size();
+      seen[f] = index;
+      outVertices.push_back(f);
+      outIndices.push_back(index);
     }
   }
+}
+
+FurBounds FurBounds::of(const vector<FurAttributes>& vertices,
+  float maxHairLength) {
+  FurBounds bounds;
+  if (vertices.empty()) {
+    bounds.lower = bounds.upper = glm::vec3(0.0f);
+    return bounds;
+  }
   
-  GLuint buffer;
-  glGenBuffers(1, &buffer);
-  glBindBuffer(GL_ARRAY_BUFFER, buffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(struct FurAttributes) * newGeom.size(),
-    newGeom.data(), GL_STATIC_DRAW);
+  bounds.lower = bounds.upper = vertices[0].xyzPosition;
+  for (const FurAttributes& f : vertices) {
+    // The shells lie between the base vertex and the outermost shell vertex.
+    glm::vec3 tip = f.xyzPosition + f.xyzNormal * maxHairLength;
+    bounds.lower = glm::min(bounds.lower, glm::min(f.xyzPosition, tip));
+    bounds.upper = glm::max(bounds.upper, glm::max(f.xyzPosition, tip));
+  }
   
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return bounds;
+}
+
+bool FurBounds::visible(const glm::mat4& projection, const glm::mat4& modelView,
+  float maxDisplacement, float maxDistance) const {
+  glm::vec3 lo = lower - glm::vec3(maxDisplacement);
+  glm::vec3 hi = upper + glm::vec3(maxDisplacement);
+  
+  glm::vec3 center = (lo + hi) * 0.5f;
+  glm::vec4 eyeCenter = modelView * glm::vec4(center, 1.0f);
+  float radius = glm::length(hi - lo) * 0.5f;
+  if (glm::length(glm::vec3(eyeCenter)) - radius > maxDistance) {
+    return false;
+  }
   
-  _vao = initVao(buffer, prog);
-  _indices = newGeom.size();
+  // The box is outside if all eight corners are beyond the same clip plane.
+  glm::mat4 mvp = projection * modelView;
+  int outside[6] = { 0, 0, 0, 0, 0, 0 };
+  for (int corner = 0; corner < 8; corner++) {
+    glm::vec4 p = mvp * glm::vec4((corner & 1) ? hi.x : lo.x,
+                                  (corner & 2) ? hi.y : lo.y,
+                                  (corner & 4) ? hi.z : lo.z, 1.0f);
+    outside[0] += p.x < -p.w;
+    outside[1] += p.x > p.w;
+    outside[2] += p.y < -p.w;
+    outside[3] += p.y > p.w;
+    outside[4] += p.z < -p.w;
+    outside[5] += p.z > p.w;
+  }
+  
+  for (int plane = 0; plane < 6; plane++) {
+    if (outside[plane] == 8) {
+      return false;
+    }
+  }
+  return true;
 }
 
-void FurGeometry::draw() const {
-  glBindVertexArray(_vao);
-  glDrawArrays(GL_TRIANGLES, 0, _indices);
+FurLod::FurLod(float fullDetailPixels, int minLayers) :
+  _fullDetailPixels(fullDetailPixels), _minLayers(max(minLayers, 2)) {}
+
+float FurLod::screenSize(const FurBounds& bounds, const glm::mat4& projection,
+  const glm::mat4& modelView, int viewportHeight) {
+  glm::vec3 center = (bounds.lower + bounds.upper) * 0.5f;
+  float radius = glm::length(bounds.upper - bounds.lower) * 0.5f;
+  
+  // Treat anything reaching past the eye as filling the screen.
+  float depth = -(modelView * glm::vec4(center, 1.0f)).z;
+  if (depth <= radius) {
+    return (float)viewportHeight;
+  }
+  
+  // projection[1][1] is cot(fovy / 2), which maps a height at unit depth to NDC.
+  return radius * projection[1][1] / depth * viewportHeight;
 }
+
+int FurLod::layers(int maxLayers, float screenPixels) const {
+  if (_fullDetailPixels <= 0.0f) {
+    return maxLayers;
+  }
+  
+  int layers = maxLayers;
+  float threshold = _fullDetailPixels;
+  while (screenPixels < threshold && layers > _minLayers) {
+    layers = max(layers / 2, _minLayers);
+    threshold *= 0.5f;
+  }
+  return layers;
+}
+
+float FurLod::fullDetailPixels() const {
+  return _fullDetailPixels;
+}
+
+int FurLod::minLayers() const {
+  return _minLayers;
+}
+
+const FurBounds& FurGeometry::bounds() const {
+  return _bounds;
+}
+
+const FurVertexFormat& FurGeometry::format() const {
+  return _format;
+}
+
+GLuint FurGeometry::positionBuffer() const {
+  return _positionBuffer;
+}
+
+void FurGeometry::setBlendMode(BlendMode mode) {
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  if (mode == BLENDED_SHELLS) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+  else {
+    glDisable(GL_BLEND);
+  }
+}
+
+int FurGeometry::layers() const {
+  return _layers;
+}
+
+void FurGeometry::setLayers(int layers) {
+  if (_mode == BAKED_SHELLS) {
+    throw logic_error("Cannot change the layer count of baked fur geometry");
+  }
+  checkLayers(layers, _mode);
+  
+  _layers = layers;
+}
+
+void FurGeometry::draw(UniformRing& ring, const glm::mat4& modelView) const {
+  FurObjectUniforms object;
+  object.modelView = modelView;
+  object.shellCount = (_mode == BAKED_SHELLS) ? 0 : _layers;
+  object.shellHeight = _maxHairLength;
+  object.packedNormals = _format.packed;
+  object.padding = 0.0f;
+  
+  GLintptr offset = ring.write(&object, sizeof(object));
+  ring.bindRange(OBJECT_BINDING, offset, sizeof(object));
+  
+  glBindVertexArray(_vao);
+  
+  if (_mode != INSTANCED_SHELLS) {
+    if (_indexType) {
+      glDrawElements(GL_TRIANGLES, _indices, _indexType, 0);
+    }
+    else {
+      glDrawArrays(GL_TRIANGLES, 0, _indices);
+    }
+  }
+  else {
+    if (_indexType) {
+      glDrawElementsInstanced(GL_TRIANGLES, _indices, _indexType, 0, _layers);
+    }
+    else {
+      glDrawArraysInstanced(GL_TRIANGLES, 0, _indices, _layers);
+    }
+  }
+}
\ No newline at end of file
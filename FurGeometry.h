@@ -4,6 +4,7 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include "ShaderProgram.h"
+#include "UniformBuffer.h"
 
 struct FurAttributes {
   glm::vec3 xyzPosition;
@@ -12,15 +13,416 @@ struct FurAttributes {
   GLfloat layer;
 };
 
+/**
+ * How FurGeometry lays out vertices on the GPU. Only the attributes a shell mode
+ * reads are uploaded: baked shells get positions, texture coordinates and layers;
+ * the other modes get positions, texture coordinates and normals. Positions stay
+ * 32-bit floats. The default format keeps every attribute as floats.
+ */
+struct FurVertexFormat {
+  /**
+   * How texture coordinates are stored. UNORM16_TEXCOORDS only holds coordinates
+   * between 0 and 1; HALF_TEXCOORDS holds any, with less precision away from 0.
+   */
+  enum TexCoords {
+    FLOAT_TEXCOORDS,
+    HALF_TEXCOORDS,
+    UNORM16_TEXCOORDS
+  };
+
+  TexCoords texCoords;
+  // Normals as two 16-bit octahedral coordinates rather than three floats, and
+  // baked layers as 16-bit fixed point.
+  bool packed;
+  // Positions in a buffer of their own, so that passes which only need depth
+  // fetch nothing else.
+  bool splitPositions;
+
+  FurVertexFormat(TexCoords texCoords = FLOAT_TEXCOORDS, bool packed = false,
+    bool splitPositions = false);
+
+  /**
+   * Returns the smallest format that holds any mesh: half-float texture
+   * coordinates and packed normals and layers.
+   * @return the compact format
+   */
+  static FurVertexFormat compact();
+
+  /**
+   * Returns the number of bytes uploaded per vertex, over all streams.
+   * @param baked whether the vertices are for baked shells
+   * @return the size of a vertex
+   */
+  size_t vertexSize(bool baked) const;
+};
+
+/**
+ * An axis-aligned box around a fur patch in model space, covering every shell.
+ */
+struct FurBounds {
+  glm::vec3 lower;
+  glm::vec3 upper;
+
+  /**
+   * Computes the box around a base mesh and all of its shells.
+   * @param vertices the base mesh vertices
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @return the bounds
+   */
+  static FurBounds of(const std::vector<FurAttributes>& vertices,
+    float maxHairLength);
+
+  /**
+   * Tests the box against the view frustum and a maximum view distance. The box is
+   * grown by the displacement first, which moves vertices by at most its length.
+   * The distance test assumes that modelView does not scale.
+   * @param projection the projection matrix
+   * @param modelView the model-view matrix of the patch
+   * @param maxDisplacement the length of the largest displacement
+   * @param maxDistance patches further than this from the eye are not visible
+   * @return whether any part of the box may be visible
+   */
+  bool visible(const glm::mat4& projection, const glm::mat4& modelView,
+    float maxDisplacement, float maxDistance) const;
+};
+
+/**
+ * Chooses how many shells to draw for a patch from its size on screen. Patches at
+ * least fullDetailPixels tall get every shell; each halving of the size below that
+ * halves the shell count, down to minLayers. The shader spreads whatever shells are
+ * drawn over the full hair length, so the fur keeps its height and profile.
+ */
+class FurLod {
+  float _fullDetailPixels;
+  int _minLayers;
+
+public:
+  /**
+   * Creates a level-of-detail policy. The default policy always draws every shell.
+   * @param fullDetailPixels the smallest on-screen height that gets every shell;
+   *                         0 disables level of detail
+   * @param minLayers the fewest shells ever drawn, including the base layer
+   */
+  explicit FurLod(float fullDetailPixels = 0.0f, int minLayers = 4);
+
+  /**
+   * Estimates the on-screen height of a patch from its bounding sphere.
+   * @param bounds the bounds of the patch
+   * @param projection the projection matrix
+   * @param modelView the model-view matrix of the patch
+   * @param viewportHeight the height of the viewport, in pixels
+   * @return the projected height, in pixels
+   */
+  static float screenSize(const FurBounds& bounds, const glm::mat4& projection,
+    const glm::mat4& modelView, int viewportHeight);
+
+  /**
+   * Chooses the number of shells for a patch.
+   * @param maxLayers the number of shells at full detail
+   * @param screenPixels the on-screen height of the patch (see screenSize())
+   * @return the number of shells to draw, including the base layer
+   */
+  int layers(int maxLayers, float screenPixels) const;
+
+  /**
+   * Returns the smallest on-screen height that gets every shell.
+   * @return the full-detail height, in pixels, or 0 if level of detail is off
+   */
+  float fullDetailPixels() const;
+
+  /**
+   * Returns the fewest shells ever drawn.
+   * @return the minimum number of shells
+   */
+  int minLayers() const;
+};
+
+/**
+ * The "Frame" uniform block of the fur shaders, laid out as std140.
+ */
+struct FurFrameUniforms {
+  glm::mat4 projection;
+  glm::vec3 displacement;
+  GLint opaqueShells;
+};
+
+/**
+ * The "Object" uniform block of the fur shaders, laid out as std140.
+ */
+struct FurObjectUniforms {
+  glm::mat4 modelView;
+  GLint shellCount;
+  GLfloat shellHeight;
+  // Nonzero if normals are octahedral-packed (see FurVertexFormat).
+  GLint packedNormals;
+  GLfloat padding;
+};
+
+/**
+ * A base mesh drawn as a stack of fur shells, each one extruded a little further
+ * along the vertex normals.
+ */
 class FurGeometry {
+public:
+  /**
+   * How the shells are produced from the base mesh.
+   * BAKED_SHELLS copies the base mesh once per layer on the CPU, so the vertex
+   * buffer holds every shell.
+   * INSTANCED_SHELLS uploads the base mesh once and draws one instance per layer;
+   * the vertex shader derives the layer from gl_InstanceID and does the extrusion.
+   * GEOMETRY_SHELLS uploads the base mesh once and draws it once; a geometry shader
+   * (shells.vert and shells.geom) emits every shell of each triangle, up to
+   * MAX_GEOMETRY_SHELLS; asking for more is an error rather than silently drawing
+   * fewer.
+   */
+  enum ShellMode {
+    BAKED_SHELLS,
+    INSTANCED_SHELLS,
+    GEOMETRY_SHELLS
+  };
+
+  /**
+   * The most shells shells.geom emits per triangle.
+   */
+  static const int MAX_GEOMETRY_SHELLS = 48;
+
+  /**
+   * How the shells are composited.
+   * BLENDED_SHELLS alpha-blends every shell over the ones below it, drawing the base
+   * layer first. Fragments without hair are blended in with an alpha of 0.
+   * ALPHA_TESTED_SHELLS discards fragments without hair and draws the rest opaque,
+   * outermost shell first. Every surviving fragment writes depth, so the hair
+   * already drawn hides most fragments of the shells below before they are shaded.
+   * Instanced shells are reordered in the vertex shader; baked shells keep their
+   * order but still skip blending.
+   */
+  enum BlendMode {
+    BLENDED_SHELLS,
+    ALPHA_TESTED_SHELLS
+  };
+
+  /**
+   * The uniform buffer binding points of the fur shaders' uniform blocks.
+   */
+  enum UniformBinding {
+    FRAME_BINDING = 0,
+    OBJECT_BINDING = 1
+  };
+
+  /**
+   * Fur geometry in its GPU layout: the buffers exactly as they are uploaded,
+   * with the vertices encoded in the vertex format and baked shells already
+   * copied out. bake() builds them on the CPU, e.g. to store in a FurAsset. The
+   * buffers are not owned.
+   */
+  struct Baked {
+    ShellMode mode;
+    int layers;
+    float maxHairLength;
+    FurVertexFormat format;
+    FurBounds bounds;
+    // The vertex attributes, including positions unless the format splits them.
+    const void* attributes;
+    size_t attributeBytes;
+    // The positions, if the format splits them; otherwise NULL.
+    const void* positions;
+    size_t positionBytes;
+    // The indices, of indexType; NULL and 0 for a flat triangle list.
+    const void* indices;
+    size_t indexBytes;
+    GLenum indexType;
+    // The number of indices, or of vertices if there are none, drawn per shell
+    // instance.
+    int count;
+  };
+
+private:
   GLuint _vao;
+  GLuint _buffer;
+  GLuint _positionBuffer;
+  GLuint _elementBuffer;
+  GLenum _indexType;
   int _indices;
-  GLuint initVao(GLuint buffer, ShaderProgram prog);
-  
+  ShellMode _mode;
+  int _layers;
+  float _maxHairLength;
+  FurBounds _bounds;
+  FurVertexFormat _format;
+  GLuint initVao(ShaderProgram& prog);
+  void init(const Baked& baked, ShaderProgram& prog);
+  template <typename Index>
+  static Baked bakeMesh(const std::vector<FurAttributes>& vertices,
+    const std::vector<Index>* indices, GLenum indexType, int layers,
+    int maxHairLength, ShellMode mode, const FurVertexFormat& format,
+    std::vector<unsigned char>& storage);
+
 public:
+  /**
+   * Constructs fur geometry from a triangle list.
+   * @param geom the base mesh, as a flat list of triangles
+   * @param prog the shader program the geometry will be drawn with
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param mode how the shells are produced (see ShellMode)
+   * @param format how the vertices are stored (see FurVertexFormat)
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
   FurGeometry(std::vector<FurAttributes>& geom, ShaderProgram& prog,
-    int layers, int maxHairLength);
-  void draw() const;
+    int layers, int maxHairLength, ShellMode mode = BAKED_SHELLS,
+    const FurVertexFormat& format = FurVertexFormat());
+
+  /**
+   * Constructs fur geometry from an indexed triangle list with 16-bit indices.
+   * Baked shells switch to 32-bit indices if the shell vertices no longer fit.
+   * @param vertices the base mesh vertices
+   * @param indices three indices into vertices per triangle
+   * @param prog the shader program the geometry will be drawn with
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param mode how the shells are produced (see ShellMode)
+   * @param format how the vertices are stored (see FurVertexFormat)
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
+  FurGeometry(const std::vector<FurAttributes>& vertices,
+    const std::vector<GLushort>& indices, ShaderProgram& prog,
+    int layers, int maxHairLength, ShellMode mode = BAKED_SHELLS,
+    const FurVertexFormat& format = FurVertexFormat());
+
+  /**
+   * Constructs fur geometry from an indexed triangle list with 32-bit indices.
+   * @param vertices the base mesh vertices
+   * @param indices three indices into vertices per triangle
+   * @param prog the shader program the geometry will be drawn with
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param mode how the shells are produced (see ShellMode)
+   * @param format how the vertices are stored (see FurVertexFormat)
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
+  FurGeometry(const std::vector<FurAttributes>& vertices,
+    const std::vector<GLuint>& indices, ShaderProgram& prog,
+    int layers, int maxHairLength, ShellMode mode = BAKED_SHELLS,
+    const FurVertexFormat& format = FurVertexFormat());
+
+  /**
+   * Uploads geometry that was baked earlier, e.g. loaded from a FurAsset.
+   * @param baked the geometry and its buffers
+   * @param prog the shader program the geometry will be drawn with
+   */
+  FurGeometry(const Baked& baked, ShaderProgram& prog);
+
+  /**
+   * Lays out a triangle list as the matching constructor would upload it, without
+   * touching OpenGL.
+   * @param geom the base mesh, as a flat list of triangles
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param mode how the shells are produced (see ShellMode)
+   * @param format how the vertices are stored (see FurVertexFormat)
+   * @param storage receives the buffers; the result points into it
+   * @return the baked geometry
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
+  static Baked bake(const std::vector<FurAttributes>& geom, int layers,
+    int maxHairLength, ShellMode mode, const FurVertexFormat& format,
+    std::vector<unsigned char>& storage);
+
+  /**
+   * Lays out an indexed triangle list with 16-bit indices as the matching
+   * constructor would upload it, without touching OpenGL.
+   * @param vertices the base mesh vertices
+   * @param indices three indices into vertices per triangle
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param mode how the shells are produced (see ShellMode)
+   * @param format how the vertices are stored (see FurVertexFormat)
+   * @param storage receives the buffers; the result points into it
+   * @return the baked geometry
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
+  static Baked bake(const std::vector<FurAttributes>& vertices,
+    const std::vector<GLushort>& indices, int layers, int maxHairLength,
+    ShellMode mode, const FurVertexFormat& format,
+    std::vector<unsigned char>& storage);
+
+  /**
+   * Lays out an indexed triangle list with 32-bit indices as the matching
+   * constructor would upload it, without touching OpenGL.
+   * @param vertices the base mesh vertices
+   * @param indices three indices into vertices per triangle
+   * @param layers the number of shells, including the base layer
+   * @param maxHairLength the distance between the base layer and the outermost shell
+   * @param mode how the shells are produced (see ShellMode)
+   * @param format how the vertices are stored (see FurVertexFormat)
+   * @param storage receives the buffers; the result points into it
+   * @return the baked geometry
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
+  static Baked bake(const std::vector<FurAttributes>& vertices,
+    const std::vector<GLuint>& indices, int layers, int maxHairLength,
+    ShellMode mode, const FurVertexFormat& format,
+    std::vector<unsigned char>& storage);
+
+  /**
+   * Welds a flat triangle list into unique vertices and an index buffer.
+   * Two vertices are merged only if all of their attributes are identical.
+   * @param geom the triangle list to weld
+   * @param outVertices where the unique vertices will be placed
+   * @param outIndices where three indices per triangle will be placed
+   */
+  static void weld(const std::vector<FurAttributes>& geom,
+    std::vector<FurAttributes>& outVertices, std::vector<GLuint>& outIndices);
+
+  /**
+   * Sets up blending and depth state for a blend mode. The shaders also have to be
+   * told through FurFrameUniforms::opaqueShells.
+   * @param mode how the shells are composited
+   */
+  static void setBlendMode(BlendMode mode);
+
+  /**
+   * Returns the number of shells drawn, including the base layer.
+   * @return the number of shells
+   */
+  int layers() const;
+
+  /**
+   * Changes the number of shells drawn. This is only supported for
+   * INSTANCED_SHELLS and GEOMETRY_SHELLS geometry, where it costs nothing; baked
+   * geometry would have to be rebuilt.
+   * @param layers the new number of shells, including the base layer
+   * @throws logic_error if the geometry uses BAKED_SHELLS
+   * @throws invalid_argument if the mode cannot draw that many layers
+   */
+  void setLayers(int layers);
+
+  /**
+   * Returns the box around the base mesh and all of its shells, not including any
+   * displacement.
+   * @return the bounds in model space
+   */
+  const FurBounds& bounds() const;
+
+  /**
+   * Returns the vertex format the geometry was uploaded in.
+   * @return the vertex format
+   */
+  const FurVertexFormat& format() const;
+
+  /**
+   * Returns the buffer holding only positions, for passes that need nothing else.
+   * @return the position buffer, or 0 unless the format splits positions
+   */
+  GLuint positionBuffer() const;
+
+  /**
+   * Draws all shells. The shader program given at construction must be in use,
+   * with its "Frame" block bound to FRAME_BINDING. The per-object block is written
+   * to the ring and bound to OBJECT_BINDING.
+   * @param ring the ring buffer for this frame's per-object blocks
+   * @param modelView the model-view matrix of this object
+   */
+  void draw(UniformRing& ring, const glm::mat4& modelView) const;
 };
 
 #endif
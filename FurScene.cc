@@ -0,0 +1,405 @@
+#include "FurScene.h"
+#include <cassert>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "FurAsset.h"
+#include "PNGImage.h"
+
+using namespace std;
+
+// The length of an imported mesh's longest side, about that of the quad.
+static const float MESH_SIZE = 40.0f;
+
+/**
+ * The base mesh a single patch is furred from: the quad, or the settings' mesh
+ * scaled to about the quad's size.
+ */
+class Patch {
+  unique_ptr<Mesh> _mesh;
+  vector<FurAttributes> _quadVertices;
+  vector<GLuint> _quadIndices;
+  glm::vec3 _origin;
+  glm::vec3 _uAxis;
+  glm::vec3 _vAxis;
+  
+public:
+  explicit Patch(const FurScene::Settings& settings) {
+    if (settings.meshFile) {
+      _mesh.reset(new Mesh(settings.meshFile));
+      _mesh->fit(glm::vec3(0.0f), MESH_SIZE);
+      return;
+    }
+  
+    // A---B
+    // \   /
+    //  C-D
+    vector<FurAttributes> vertices;
+    FurAttributes fa;
+    fa = {{ 20.0, -20.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0}, 0.0}; // D
+    vertices.push_back(fa);
+    fa = {{ 30.0,  20.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 1.0}, 0.0}; // B
+    vertices.push_back(fa);
+    fa = {{-30.0,  20.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 1.0}, 0.0}; // A
+    vertices.push_back(fa);
+  
+    fa = {{-30.0,  20.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 1.0}, 0.0}; // A
+    vertices.push_back(fa);
+    fa = {{-20.0, -20.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 0.0}, 0.0}; // C
+    vertices.push_back(fa);
+    fa = {{ 20.0, -20.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0}, 0.0}; // D
+    vertices.push_back(fa);
+  
+    // Weld the shared corners so each shell only uploads four vertices.
+    FurGeometry::weld(vertices, _quadVertices, _quadIndices);
+  
+    // The plane spans the quad's average edges; its sides are not quite parallel.
+    const glm::vec3& c = vertices[4].xyzPosition;
+    const glm::vec3& d = vertices[0].xyzPosition;
+    const glm::vec3& b = vertices[1].xyzPosition;
+    const glm::vec3& a = vertices[2].xyzPosition;
+    _uAxis = ((d - c) + (b - a)) * 0.5f;
+    _vAxis = ((a - c) + (b - d)) * 0.5f;
+    _origin = (a + b + c + d) * 0.25f - (_uAxis + _vAxis) * 0.5f;
+  }
+  
+  // A mesh is handed over without copying.
+  const vector<FurAttributes>& vertices() const {
+    return _mesh ? _mesh->vertices() : _quadVertices;
+  }
+  
+  const vector<GLuint>& indices() const {
+    return _mesh ? _mesh->indices() : _quadIndices;
+  }
+  
+  /**
+   * Returns the plane the texture coordinates span, for a deformation map. Meshes
+   * are not flat, so they have none.
+   * @return whether the patch is flat
+   */
+  bool plane(glm::vec3& origin, glm::vec3& uAxis, glm::vec3& vAxis) const {
+    origin = _origin;
+    uAxis = _uAxis;
+    vAxis = _vAxis;
+    return !_mesh;
+  }
+};
+
+FurScene::Settings::Settings()
+  : furSize(512), furDensity(0.4f), furLayers(40), furSeed(0),
+    furFormat(FurTexture::R8), furHeight(2),
+    shellMode(FurGeometry::INSTANCED_SHELLS),
+    vertexFormat(FurVertexFormat::compact()),
+    blendMode(FurGeometry::BLENDED_SHELLS), grid(0), gridSpacing(60.0f),
+    cullDistance(100.0f), lodPixels(250.0f), fieldSize(64), fieldBudgetMs(1.0),
+    deformationSize(128), colorImage("grass.png"), meshFile(NULL),
+    assetFile(NULL) {}
+
+FurScene::FurScene(const Settings& settings, FileCache* cache,
+  TextureStreamer* streamer)
+  : _settings(settings), _streamer(streamer), _frame(FurFrameUniforms()),
+    _lod(settings.lodPixels), _lastTime(-1.0) {
+  // An asset decides how its shells are drawn, so it is read before the shaders
+  // are chosen.
+  unique_ptr<FurAsset> asset;
+  if (_settings.assetFile) {
+    // FurBatch needs the base mesh, which an asset does not keep.
+    if (_settings.grid > 0) {
+      throw invalid_argument("A fur asset cannot be drawn as a grid");
+    }
+    asset.reset(new FurAsset(_settings.assetFile));
+    const FurAsset::Contents& contents = asset->contents();
+    _settings.shellMode = contents.geometry.mode;
+    _settings.furLayers = contents.geometry.layers;
+    _settings.furHeight = (int)(contents.geometry.maxHairLength + 0.5f);
+    _settings.vertexFormat = contents.geometry.format;
+    _settings.furFormat = contents.furFormat;
+    _settings.furSize = contents.furWidth;
+  }
+  
+  // A field of patches is drawn as one FurBatch, which has its own vertex shader.
+  // Geometry-shader shells need their own vertex and geometry shaders.
+  const bool batched = _settings.grid > 0;
+  const bool geometryShells =
+    !batched && _settings.shellMode == FurGeometry::GEOMETRY_SHELLS;
+  const char* vertexShader = batched ? "batch.vert" :
+    geometryShells ? "shells.vert" : "default.vert";
+  _prog.reset(new ShaderProgram(vertexShader, "default.frag",
+    geometryShells ? "shells.geom" : "", cache));
+  assert(_prog->hasAttribute("pos"));
+  assert(_prog->hasAttribute("texCoord"));
+  assert(batched || geometryShells || _prog->hasAttribute("layer"));
+  assert(_prog->hasAttribute("norm"));
+  assert(!batched || _prog->hasAttribute("patchIndex"));
+  assert(_prog->hasUniform("fur"));
+  assert(_prog->hasUniform("color"));
+  assert(!batched || _prog->hasUniform("patches"));
+  assert(_prog->hasUniform("displacementField"));
+  assert(batched || _prog->hasUniform("deformationMap"));
+  assert(_prog->hasUniformBlock("Frame"));
+  assert(batched || _prog->hasUniformBlock("Object"));
+  
+  _prog->use();
+  _prog->bindUniformBlock("Frame", FurGeometry::FRAME_BINDING);
+  _prog->bindUniformBlock("Object", FurGeometry::OBJECT_BINDING);
+  
+  // Load textures. The color texture is decoded on another thread while the fur
+  // map is generated; only the upload has to happen on this thread. An asset's
+  // textures are uploaded straight from the file.
+  future<PNGImage> furColorImage;
+  if (!asset) {
+    const char* colorImage = _settings.colorImage;
+    furColorImage = async(launch::async, [colorImage] {
+      return PNGImage(colorImage);
+    });
+  }
+  
+  glActiveTexture(GL_TEXTURE0);
+  if (asset) {
+    const FurAsset::Contents& contents = asset->contents();
+    _fur.reset(new FurTexture(contents.furWidth, contents.furHeight,
+      contents.furFormat, contents.furPixels, asset->owner()));
+  }
+  else {
+    _fur.reset(new FurTexture(_settings.furSize, _settings.furSize,
+      _settings.furLayers, _settings.furDensity, _settings.furSeed, cache,
+      _settings.furFormat));
+  }
+  glUniform1i(_prog->getUniform("fur"), 0);
+  
+  glActiveTexture(GL_TEXTURE1);
+  if (asset) {
+    const FurAsset::Contents& contents = asset->contents();
+    _color.reset(new Texture(contents.colorWidth, contents.colorHeight,
+      contents.colorChannels, contents.colorPixels, asset->owner(), _streamer));
+  }
+  else if (_streamer) {
+    _color.reset(new Texture(furColorImage.get(), *_streamer));
+  }
+  else {
+    _color.reset(new Texture(furColorImage.get()));
+  }
+  glUniform1i(_prog->getUniform("color"), 1);
+  
+  // Wind sways each part of the patch on its own; without a field, the whole
+  // patch sways with the frame's displacement.
+  if (_settings.fieldSize > 0) {
+    glActiveTexture(GL_TEXTURE3);
+    _field.reset(new DisplacementField(_settings.fieldSize, _settings.fieldSize,
+      _settings.furSeed));
+    _field->setWind(glm::vec3(0.5f, 0.0f, 0.0f), 0.8f);
+    _field->setBudget(_settings.fieldBudgetMs);
+  }
+  glUniform1i(_prog->getUniform("displacementField"), 3);
+  
+  // Initialize geometry.
+  unique_ptr<Patch> patch;
+  if (!asset) {
+    patch.reset(new Patch(_settings));
+  }
+  
+  if (batched) {
+    _batch.reset(new FurBatch(*_prog, 2));
+  }
+  else {
+    glm::vec3 origin, uAxis, vAxis;
+    bool flat;
+    if (asset) {
+      const FurAsset::Contents& contents = asset->contents();
+      _geom.reset(new FurGeometry(contents.geometry, *_prog));
+      flat = contents.flat;
+      origin = contents.origin;
+      uAxis = contents.uAxis;
+      vAxis = contents.vAxis;
+    }
+    else {
+      _geom.reset(new FurGeometry(patch->vertices(), patch->indices(), *_prog,
+        _settings.furLayers, _settings.furHeight, _settings.shellMode,
+        _settings.vertexFormat));
+      flat = patch->plane(origin, uAxis, vAxis);
+    }
+    
+    if (_settings.deformationSize > 0 && flat) {
+      glActiveTexture(GL_TEXTURE4);
+      _deformation.reset(new DeformationMap(_settings.deformationSize,
+        _settings.deformationSize, origin, uAxis, vAxis,
+        (float)_settings.furHeight));
+    }
+  }
+  glUniform1i(_prog->getUniform("deformationMap"), 4);
+  
+  // Projection and model-view matrices.
+  glm::vec3 xAxis(1.0f, 0.0f, 0.0f);
+  _view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -30.0f)) *
+    glm::rotate(glm::mat4(1.0f), glm::radians(-60.0f), xAxis);
+  
+  // Lay out the field around the origin, growing away from the camera.
+  for (int row = 0; row < _settings.grid; row++) {
+    for (int col = 0; col < _settings.grid; col++) {
+      glm::vec3 offset((col - _settings.grid / 2) * _settings.gridSpacing,
+        row * _settings.gridSpacing, 0.0f);
+      _batch->add(patch->vertices(), patch->indices(), _settings.furLayers,
+        (float)_settings.furHeight,
+        _view * glm::translate(glm::mat4(1.0f), offset));
+    }
+  }
+  
+  _frame.opaqueShells = (_settings.blendMode == FurGeometry::ALPHA_TESTED_SHELLS);
+}
+
+void FurScene::bake(const Settings& settings, const char* fileName) {
+  // Decode the color image while the geometry is laid out and the fur map is
+  // generated, as the constructor does.
+  const char* colorImage = settings.colorImage;
+  future<PNGImage> furColorImage = async(launch::async, [colorImage] {
+    return PNGImage(colorImage);
+  });
+  
+  FurAsset::Contents contents;
+  Patch patch(settings);
+  vector<unsigned char> geometry;
+  contents.geometry = FurGeometry::bake(patch.vertices(), patch.indices(),
+    settings.furLayers, settings.furHeight, settings.shellMode,
+    settings.vertexFormat, geometry);
+  contents.flat = patch.plane(contents.origin, contents.uAxis, contents.vAxis);
+  
+  vector<RGBColor> rgba;
+  vector<unsigned char> r8;
+  if (settings.furFormat == FurTexture::R8) {
+    FurTexture::generate(r8, settings.furSize, settings.furSize,
+      settings.furLayers, settings.furDensity, settings.furSeed);
+    contents.furPixels = &r8[0];
+  }
+  else {
+    FurTexture::generate(rgba, settings.furSize, settings.furSize,
+      settings.furLayers, settings.furDensity, settings.furSeed);
+    contents.furPixels = (const unsigned char*)&rgba[0];
+  }
+  contents.furWidth = settings.furSize;
+  contents.furHeight = settings.furSize;
+  contents.furFormat = settings.furFormat;
+  
+  PNGImage color = furColorImage.get();
+  contents.colorWidth = color.width();
+  contents.colorHeight = color.height();
+  contents.colorChannels = color.channels();
+  contents.colorPixels = color.pixels()->data();
+  
+  FurAsset::write(fileName, contents);
+}
+
+const FurScene::Settings& FurScene::settings() const {
+  return _settings;
+}
+
+DeformationMap* FurScene::deformation() {
+  return _deformation.get();
+}
+
+bool FurScene::unproject(double x, double y, int width, int height,
+  glm::vec3& point) const {
+  // Cast a ray from the near to the far plane through the point, in model space.
+  glm::mat4 toModel = glm::inverse(_frame.projection * _view);
+  float ndcX = (float)(2.0 * x / width - 1.0);
+  float ndcY = (float)(1.0 - 2.0 * y / height);
+  glm::vec4 nearPoint = toModel * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+  glm::vec4 farPoint = toModel * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+  glm::vec3 from = glm::vec3(nearPoint) / nearPoint.w;
+  glm::vec3 to = glm::vec3(farPoint) / farPoint.w;
+  
+  // The patch lies in the z = 0 plane.
+  if ((from.z > 0.0f) == (to.z > 0.0f)) {
+    return false;
+  }
+  float t = from.z / (from.z - to.z);
+  point = from + t * (to - from);
+  return true;
+}
+
+bool FurScene::ready() const {
+  return _fur->ready() && _color->ready();
+}
+
+void FurScene::render(double time, int width, int height, Profiler* profiler) {
+  // Other code may have changed these since the last frame.
+  _prog->use();
+  FurGeometry::setBlendMode(_settings.blendMode);
+  glViewport(0, 0, width, height);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  
+  {
+    Profiler::Scope scope(profiler, "uniforms");
+    float ratio = width / (float)height;
+    _frame.projection = glm::perspective(glm::radians(60.0f), ratio, 0.1f, 100.0f);
+    
+    // Simple physics: gravity, plus a breeze unless the field brings wind.
+    glm::vec3 gravity(0.0f, -0.8f, 0.0f);
+    glm::vec3 force(_field ? 0.0f : sin(time) * 0.5f, 0.0f, 0.0f);
+    _frame.displacement = gravity + force;
+    
+    // Per-frame state is only uploaded when it changes; per-object state goes
+    // through the ring, one range per draw.
+    _frameUniforms.set(_frame);
+    _frameUniforms.bind(FurGeometry::FRAME_BINDING);
+  }
+  
+  if (_field) {
+    Profiler::Scope scope(profiler, "physics");
+    _field->update(_lastTime >= 0.0 ? time - _lastTime : 0.0);
+    glActiveTexture(GL_TEXTURE3);
+    _field->bind();
+  }
+  if (_deformation) {
+    Profiler::Scope scope(profiler, "deformation");
+    _deformation->update(_lastTime >= 0.0 ? time - _lastTime : 0.0);
+    glActiveTexture(GL_TEXTURE4);
+    _deformation->bind();
+  }
+  _lastTime = time;
+  
+  // Continue any texture uploads. Until they finish the fur would sample black,
+  // so it is not drawn before then.
+  if (_streamer) {
+    Profiler::Scope scope(profiler, "textures");
+    _streamer->update();
+  }
+  if (!ready()) {
+    return;
+  }
+  
+  // Draw whatever may be visible.
+  const float maxDisplacement = glm::length(_frame.displacement) +
+    (_field ? _field->maxDisplacement() : 0.0f) +
+    (_deformation ? _deformation->maxDeformation() : 0.0f);
+  if (_batch) {
+    {
+      Profiler::Scope scope(profiler, "cull");
+      _batch->cull(_frame.projection, maxDisplacement, _settings.cullDistance,
+        height, _lod);
+    }
+    Profiler::Scope scope(profiler, "draw");
+    _batch->draw();
+  }
+  else {
+    _objectUniforms.beginFrame();
+    bool visible;
+    {
+      Profiler::Scope scope(profiler, "cull");
+      visible = _geom->bounds().visible(_frame.projection, _view, maxDisplacement,
+        _settings.cullDistance);
+      // Baked shells cannot change their layer count.
+      if (visible && _settings.shellMode != FurGeometry::BAKED_SHELLS) {
+        float pixels = FurLod::screenSize(_geom->bounds(), _frame.projection, _view,
+          height);
+        _geom->setLayers(_lod.layers(_settings.furLayers, pixels));
+      }
+    }
+    if (visible) {
+      Profiler::Scope scope(profiler, "draw");
+      _geom->draw(_objectUniforms, _view);
+    }
+    _objectUniforms.endFrame();
+  }
+}
@@ -0,0 +1,149 @@
+#ifndef _FURSCENE_H_
+#define _FURSCENE_H_
+
+#include <memory>
+#include <glm/glm.hpp>
+#include "DeformationMap.h"
+#include "DisplacementField.h"
+#include "FileCache.h"
+#include "FurBatch.h"
+#include "FurGeometry.h"
+#include "FurTexture.h"
+#include "Mesh.h"
+#include "Profiler.h"
+#include "ShaderProgram.h"
+#include "Texture.h"
+#include "TextureStreamer.h"
+#include "UniformBuffer.h"
+
+/**
+ * The demo scene: a furry quad, or a field of them, with its shaders, textures and
+ * per-frame state. Rendering depends only on the settings and the time passed to
+ * render(), so the same frame can be drawn in a window or offscreen.
+ */
+class FurScene {
+public:
+  /**
+   * Everything that decides what the scene looks like. The defaults are the demo's.
+   */
+  struct Settings {
+    int furSize;
+    float furDensity;
+    int furLayers;
+    uint32_t furSeed;
+    FurTexture::Format furFormat;
+    int furHeight;
+    FurGeometry::ShellMode shellMode;
+    FurVertexFormat vertexFormat; // Not used by a grid, which FurBatch draws.
+    FurGeometry::BlendMode blendMode;
+    int grid; // If nonzero, draw a grid x grid field of patches.
+    float gridSpacing;
+    float cullDistance;
+    float lodPixels; // Smaller patches get fewer shells; 0 turns LOD off.
+    int fieldSize; // Cells per side of the displacement field; 0 for none.
+    double fieldBudgetMs; // CPU time the field may take per frame.
+    int deformationSize; // Texels per side of the deformation map; 0 for none.
+    const char* colorImage;
+    const char* meshFile; // An OBJ or PLY mesh to fur instead of the quad.
+    // A file baked by bake(). Its geometry, fur map and color image replace the
+    // ones the settings above describe, as do its shell mode and vertex format.
+    // It holds a single patch, so it cannot be combined with grid.
+    const char* assetFile;
+
+    Settings();
+  };
+
+private:
+  Settings _settings;
+  std::unique_ptr<ShaderProgram> _prog;
+  std::unique_ptr<FurTexture> _fur;
+  std::unique_ptr<Texture> _color;
+  std::unique_ptr<FurGeometry> _geom;
+  std::unique_ptr<FurBatch> _batch;
+  std::unique_ptr<DisplacementField> _field;
+  std::unique_ptr<DeformationMap> _deformation;
+  TextureStreamer* _streamer;
+  UniformBlock<FurFrameUniforms> _frameUniforms;
+  UniformRing _objectUniforms;
+  FurFrameUniforms _frame;
+  FurLod _lod;
+  glm::mat4 _view;
+  double _lastTime;
+
+  FurScene(const FurScene&);
+  FurScene& operator=(const FurScene&);
+
+public:
+  /**
+   * Loads the shaders and textures and builds the geometry. Needs a current
+   * OpenGL 3.3 context.
+   * @param settings what to draw
+   * @param cache (optional) where to keep linked programs and fur maps
+   * @param streamer (optional) streams the color texture in over the first frames
+   *                 instead of uploading it right away
+   * @throws ifstream::failure if a shader could not be read
+   * @throws GLSLError if a shader could not be compiled or linked
+   * @throws PNGError if the color image could not be decoded
+   * @throws IOError if the mesh could not be read
+   * @throws MeshError if the mesh is malformed
+   * @throws AssetError if the asset is not one of this version or is damaged
+   * @throws invalid_argument if an asset is to be drawn as a grid
+   */
+  FurScene(const Settings& settings, FileCache* cache = NULL,
+    TextureStreamer* streamer = NULL);
+
+  /**
+   * Builds everything the scene would build from the settings, in its GPU layout,
+   * and writes it to a FurAsset that later loads without any of that work. The
+   * shell mode and vertex format are baked in; assetFile is ignored. Does not
+   * need an OpenGL context.
+   * @param settings what to bake
+   * @param fileName the path to write the asset to
+   * @throws PNGError if the color image could not be decoded
+   * @throws IOError if the mesh could not be read or the asset not written
+   * @throws MeshError if the mesh is malformed
+   */
+  static void bake(const Settings& settings, const char* fileName);
+
+  /**
+   * Returns the settings the scene was built with.
+   * @return the settings
+   */
+  const Settings& settings() const;
+
+  /**
+   * Indicates whether every texture is resident, i.e. whether frames look final.
+   * @return whether all texture uploads have finished
+   */
+  bool ready() const;
+
+  /**
+   * Returns the map colliders push the hair aside in. Only a single patch has one.
+   * @return the deformation map, or NULL if there is none
+   */
+  DeformationMap* deformation();
+
+  /**
+   * Finds the point on the patch's plane under a point in the last frame drawn.
+   * @param x the horizontal position, from the left edge
+   * @param y the vertical position, from the top edge
+   * @param width the width of the window or framebuffer x and y are relative to
+   * @param height the height of the window or framebuffer x and y are relative to
+   * @param point receives the point on the plane, in model space
+   * @return whether the point lies on the plane in front of the camera
+   */
+  bool unproject(double x, double y, int width, int height, glm::vec3& point) const;
+
+  /**
+   * Clears and draws one frame into the current framebuffer. The fur is left out
+   * until ready().
+   * @param time the animation time, in seconds
+   * @param width the width of the framebuffer, in pixels
+   * @param height the height of the framebuffer, in pixels
+   * @param profiler (optional) times the uniform, physics, deformation, texture,
+   *                 cull and draw stages
+   */
+  void render(double time, int width, int height, Profiler* profiler = NULL);
+};
+
+#endif
@@ -1,43 +1,221 @@
 #include "FurTexture.h"
-#include <cstdlib>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
 
 using namespace std;
 
-FurTexture::FurTexture(int width, int height, int layers, float density) :
-  _tex(make_shared<vector<RGBColor>>(width * height)) {
-  int totalPixels = width * height;
-  vector<RGBColor> texArray = *_tex;
-  
-  // Initialize colors to transparent black.
-  for (int i = 0; i < totalPixels; i++) {
-    texArray[i] = RGBColor();
+/**
+ * The SplitMix64 finalizer. Mixing a counter with it gives a counter-based random
+ * stream: any element of the stream can be computed without computing the others.
+ */
+static inline uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+/**
+ * Converts random bits to a float in [0, 1).
+ */
+static inline float unitFloat(uint64_t bits) {
+  return (float)(bits >> 40) * (1.0f / 16777216.0f);
+}
+
+/**
+ * Fills a zeroed strand map with either one byte (height) or four bytes (height,
+ * 0, 0, presence) per pixel.
+ */
+static long long generatePixels(unsigned char* out, int bytesPerPixel, int width,
+  int height, int layers, float density, uint32_t seed, WorkerPool& pool) {
+  // Scattering density * width * height strands uniformly gives each pixel a
+  // Poisson-distributed number of strands, and the strands are spread evenly over
+  // the layers. A pixel only shows its tallest strand, so we can sample each
+  // pixel independently instead of scattering strands across the whole texture.
+  vector<unsigned char> layerHeights(layers);
+  for (int i = 0; i < layers; i++) {
+    float maxLayer = pow((float)i / (float)layers, 0.7f);
+    layerHeights[i] = (unsigned char)(maxLayer * 255);
   }
   
-  // Compute the number of opaque pixels (hair strands).
-  int numStrands = (int)(density * totalPixels);
-  int strandsPerLayer = numStrands / layers;
+  const float noStrands = exp(-density);
+  const uint64_t seedKey = mix64(seed);
+  atomic<long long> totalStrands(0);
   
-  // Fill texture with opaque pixels.
-  for (int i = 0; i < numStrands; i++) {
-    // Choose a random position on the texture.
-    int x = rand() % height;
-    int y = rand() % width;
+  int rowsPerChunk = max(1, 16384 / max(width, 1));
+  pool.parallelFor(height, rowsPerChunk, [&](int rowBegin, int rowEnd) {
+    long long strands = 0;
     
-    // Compute max layer.
-    float maxLayer = pow((float)(i / strandsPerLayer) / (float)layers, 0.7);
+    for (int row = rowBegin; row < rowEnd; row++) {
+      unsigned char* rowPixels = out + (size_t)row * width * bytesPerPixel;
+      for (int col = 0; col < width; col++) {
+        uint64_t pixelKey = mix64(seedKey ^ ((uint64_t)row * width + col));
+        
+        // Invert the Poisson CDF to get the number of strands in this pixel.
+        float u = unitFloat(mix64(pixelKey));
+        float p = noStrands;
+        float cdf = p;
+        int count = 0;
+        while (u > cdf && count < 64) {
+          count++;
+          p *= density / count;
+          cdf += p;
+        }
+        
+        if (count == 0) {
+          continue;
+        }
+        
+        int maxLayer = 0;
+        for (int i = 1; i <= count; i++) {
+          int layer = (int)(unitFloat(mix64(pixelKey + i)) * layers);
+          maxLayer = max(maxLayer, min(layer, layers - 1));
+        }
+        
+        unsigned char* pixel = rowPixels + col * bytesPerPixel;
+        pixel[0] = layerHeights[maxLayer];
+        if (bytesPerPixel == 4) {
+          pixel[3] = 255;
+        }
+        strands += count;
+      }
+    }
     
-    texArray[x * width + y] = RGBColor((unsigned char)(maxLayer * 255),
-                                       0,
-                                       0,
-                                       255);
+    totalStrands += strands;
+  });
+  
+  return totalStrands;
+}
+
+long long FurTexture::generate(vector<RGBColor>& out, int width, int height,
+  int layers, float density, uint32_t seed, WorkerPool& pool) {
+  out.assign((size_t)width * height, RGBColor());
+  return generatePixels((unsigned char*)out.data(), sizeof(RGBColor), width,
+    height, layers, density, seed, pool);
+}
+
+long long FurTexture::generate(vector<unsigned char>& out, int width, int height,
+  int layers, float density, uint32_t seed, WorkerPool& pool) {
+  out.assign((size_t)width * height, 0);
+  return generatePixels(out.data(), 1, width, height, layers, density, seed, pool);
+}
+
+namespace {
+  /**
+   * The header of a cached strand map. The whole header is hashed to form the
+   * cache key, so bump the version whenever generate() changes its output.
+   */
+  struct FurCacheHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t layers;
+    float density;
+    uint32_t seed;
+    uint32_t bytesPerPixel;
+  };
+}
+
+FurTexture::FurTexture(int width, int height, int layers, float density,
+  uint32_t seed, FileCache* cache, Format format, TextureStreamer* streamer) {
+  const int bytesPerPixel = (format == R8) ? 1 : sizeof(RGBColor);
+  
+  FurCacheHeader header;
+  memcpy(header.magic, "FURT", 4);
+  header.version = 1;
+  header.width = width;
+  header.height = height;
+  header.layers = layers;
+  header.density = density;
+  header.seed = seed;
+  header.bytesPerPixel = bytesPerPixel;
+  
+  const size_t pixelBytes = (size_t)width * height * bytesPerPixel;
+  const uint64_t key = FileCache::hash(&header, sizeof(header));
+  
+  shared_ptr<MappedFile> cached;
+  if (cache) {
+    cached = cache->load(key, ".fur");
+    if (cached && (cached->size() != sizeof(header) + pixelBytes ||
+                   memcmp(cached->data(), &header, sizeof(header)) != 0)) {
+      // Truncated file or hash collision; regenerate.
+      cached.reset();
+    }
   }
   
+  // Whatever holds the pixels has to outlive a streamed upload.
+  shared_ptr<const void> owner;
+  const unsigned char* pixels;
+  if (cached) {
+    owner = cached;
+    pixels = cached->data() + sizeof(header);
+  }
+  else {
+    if (format == R8) {
+      shared_ptr<vector<unsigned char>> heightArray =
+        make_shared<vector<unsigned char>>();
+      generate(*heightArray, width, height, layers, density, seed);
+      owner = heightArray;
+      pixels = heightArray->data();
+    }
+    else {
+      shared_ptr<vector<RGBColor>> texArray = make_shared<vector<RGBColor>>();
+      generate(*texArray, width, height, layers, density, seed);
+      owner = texArray;
+      pixels = (const unsigned char*)texArray->data();
+    }
+    
+    if (cache) {
+      cache->store(key, ".fur", &header, sizeof(header), pixels, pixelBytes);
+    }
+  }
+  
+  upload(width, height, format, pixels, owner, streamer);
+}
+
+FurTexture::FurTexture(int width, int height, Format format,
+  const unsigned char* pixels, const shared_ptr<const void>& owner,
+  TextureStreamer* streamer) {
+  upload(width, height, format, pixels, owner, streamer);
+}
+
+void FurTexture::upload(int width, int height, Format format,
+  const unsigned char* pixels, const shared_ptr<const void>& owner,
+  TextureStreamer* streamer) {
+  const int bytesPerPixel = (format == R8) ? 1 : sizeof(RGBColor);
+  const GLint internalFormat = (format == R8) ? GL_R8 : GL_RGBA;
+  const GLenum pixelFormat = (format == R8) ? GL_RED : GL_RGBA;
+  
   GLuint textureId;
   glGenTextures(1, &textureId);
   glBindTexture(GL_TEXTURE_2D, textureId);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-    GL_RGBA, GL_UNSIGNED_BYTE, texArray.data());
+  if (streamer) {
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+      pixelFormat, GL_UNSIGNED_BYTE, NULL);
+    streamer->enqueue(textureId, width, height, pixelFormat, bytesPerPixel,
+      pixels, owner, false);
+  }
+  else {
+    // Rows of single bytes are not 4-byte aligned in general.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+      pixelFormat, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  
+  _texture = textureId;
+  _streamer = streamer;
+}
+
+void FurTexture::bind() const {
+  glBindTexture(GL_TEXTURE_2D, _texture);
+}
+
+bool FurTexture::ready() const {
+  return !_streamer || _streamer->ready(_texture);
 }
\ No newline at end of file
@@ -3,25 +3,116 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <cstdint>
 #include <memory>
 #include <vector>
+#include "FileCache.h"
+#include "RGBColor.h"
+#include "TextureStreamer.h"
+#include "WorkerPool.h"
 
-struct RGBColor {
-  unsigned char r;
-  unsigned char g;
-  unsigned char b;
-  unsigned char a;
-  
-  RGBColor() : r(0), g(0), b(0), a(0) {}
-  RGBColor(unsigned char rr, unsigned char gg, unsigned char bb, unsigned char aa) :
-    r(rr), g(gg), b(bb), a(aa) {}
-};
-
+/**
+ * A randomly generated map of hair strands.
+ * The red channel of each pixel is the highest layer (0-255) its strand reaches.
+ * Upon construction, an OpenGL texture will automatically be created and bound.
+ */
 class FurTexture {
-  const std::shared_ptr<std::vector<RGBColor>> _tex;
+public:
+  /**
+   * The pixel format of the strand map.
+   * RGBA8 stores the strand height in red and strand presence in alpha.
+   * R8 stores only the strand height: a pixel without a strand has height 0, and
+   * every shell above the base layer is taller than that, so presence is implied.
+   */
+  enum Format {
+    RGBA8,
+    R8
+  };
+  
+private:
+  GLuint _texture;
+  TextureStreamer* _streamer;
+  void upload(int width, int height, Format format, const unsigned char* pixels,
+    const std::shared_ptr<const void>& owner, TextureStreamer* streamer);
   
 public:
-  FurTexture(int width, int height, int layers, float density);
+  /**
+   * Generates a strand map and uploads it into a new OpenGL texture.
+   * If a cache is given and already holds a map with the same parameters, the
+   * cached map is memory-mapped and uploaded instead; otherwise the generated map
+   * is added to the cache.
+   * @param width the width of the texture, in pixels
+   * @param height the height of the texture, in pixels
+   * @param layers the number of fur layers the strand heights are quantized to
+   * @param density the average number of strands per pixel
+   * @param seed the random seed; the same seed always gives the same texture
+   * @param cache (optional) the cache to look up and store generated maps in
+   * @param format the pixel format of the texture
+   * @param streamer (optional) streams the pixels in over the next frames instead
+   *                 of uploading them right away; see ready()
+   */
+  FurTexture(int width, int height, int layers, float density, uint32_t seed = 0,
+    FileCache* cache = NULL, Format format = RGBA8,
+    TextureStreamer* streamer = NULL);
+  
+  /**
+   * Uploads a strand map generated earlier, e.g. one loaded from a FurAsset.
+   * @param width the width of the texture, in pixels
+   * @param height the height of the texture, in pixels
+   * @param format the pixel format of the pixels and the texture
+   * @param pixels the strand map, as filled by generate()
+   * @param owner (optional) keeps the pixels alive until a streamed upload is done
+   * @param streamer (optional) streams the pixels in over the next frames instead
+   *                 of uploading them right away; see ready()
+   */
+  FurTexture(int width, int height, Format format, const unsigned char* pixels,
+    const std::shared_ptr<const void>& owner = std::shared_ptr<const void>(),
+    TextureStreamer* streamer = NULL);
+  
+  /**
+   * Fills a strand map on the CPU.
+   * Every pixel draws from its own counter-based random stream, so the output
+   * depends only on the parameters and the seed, never on the number of threads.
+   * @param out the output pixels, resized to width * height
+   * @param width the width of the texture, in pixels
+   * @param height the height of the texture, in pixels
+   * @param layers the number of fur layers the strand heights are quantized to
+   * @param density the average number of strands per pixel
+   * @param seed the random seed
+   * @param pool the threads to generate with
+   * @return the number of strands placed
+   */
+  static long long generate(std::vector<RGBColor>& out, int width, int height,
+    int layers, float density, uint32_t seed,
+    WorkerPool& pool = WorkerPool::shared());
+  
+  /**
+   * Fills a single-channel (R8) strand map on the CPU. Identical to the RGBA8
+   * version except that only the strand heights are written.
+   * @param out the output pixels, resized to width * height
+   * @param width the width of the texture, in pixels
+   * @param height the height of the texture, in pixels
+   * @param layers the number of fur layers the strand heights are quantized to
+   * @param density the average number of strands per pixel
+   * @param seed the random seed
+   * @param pool the threads to generate with
+   * @return the number of strands placed
+   */
+  static long long generate(std::vector<unsigned char>& out, int width, int height,
+    int layers, float density, uint32_t seed,
+    WorkerPool& pool = WorkerPool::shared());
+  
+  /**
+   * Binds the texture to the current OpenGL context.
+   */
+  void bind() const;
+  
+  /**
+   * Indicates whether the strand map has finished uploading. Always true unless
+   * the texture was created with a TextureStreamer.
+   * @return whether the texture contents are resident
+   */
+  bool ready() const;
 };
 
 #endif
\ No newline at end of file
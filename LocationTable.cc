@@ -0,0 +1,87 @@
+#include "LocationTable.h"
+#include <cstring>
+
+using namespace std;
+
+LocationTable::LocationTable() : _count(0), _mask(0) {}
+
+uint64_t LocationTable::hash(const char* name) {
+  // FNV-1a, stopping at the terminator so the length never has to be computed.
+  uint64_t result = 14695981039346656037ull;
+  for (const unsigned char* c = (const unsigned char*)name; *c; c++) {
+    result = (result ^ *c) * 1099511628211ull;
+  }
+  return result;
+}
+
+void LocationTable::grow() {
+  vector<Slot> old;
+  old.swap(_slots);
+
+  size_t capacity = old.empty() ? 16 : old.size() * 2;
+  Slot empty = { 0, -1, -1 };
+  _slots.assign(capacity, empty);
+  _mask = capacity - 1;
+
+  for (const Slot& slot : old) {
+    if (slot.name < 0) {
+      continue;
+    }
+
+    uint64_t i = slot.hash & _mask;
+    while (_slots[i].name >= 0) {
+      i = (i + 1) & _mask;
+    }
+    _slots[i] = slot;
+  }
+}
+
+void LocationTable::insert(const char* name, GLint location) {
+  // Keep at least half of the slots free so that probe runs stay short.
+  if ((size_t)(_count + 1) * 2 > _slots.size()) {
+    grow();
+  }
+
+  uint64_t h = hash(name);
+  uint64_t i = h & _mask;
+  while (_slots[i].name >= 0) {
+    if (_slots[i].hash == h && strcmp(&_names[_slots[i].name], name) == 0) {
+      _slots[i].location = location;
+      return;
+    }
+    i = (i + 1) & _mask;
+  }
+
+  Slot slot = { h, location, (int)_names.size() };
+  _names.insert(_names.end(), name, name + strlen(name) + 1);
+  _slots[i] = slot;
+  _count++;
+}
+
+GLint LocationTable::find(const char* name) const {
+  if (_count == 0) {
+    return -1;
+  }
+
+  uint64_t h = hash(name);
+  uint64_t i = h & _mask;
+  while (_slots[i].name >= 0) {
+    if (_slots[i].hash == h && strcmp(&_names[_slots[i].name], name) == 0) {
+      return _slots[i].location;
+    }
+    i = (i + 1) & _mask;
+  }
+
+  return -1;
+}
+
+int LocationTable::size() const {
+  return _count;
+}
+
+void LocationTable::clear() {
+  _slots.clear();
+  _names.clear();
+  _count = 0;
+  _mask = 0;
+}
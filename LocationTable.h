@@ -0,0 +1,66 @@
+#ifndef _LOCATIONTABLE_H_
+#define _LOCATIONTABLE_H_
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A fixed set of names and their GLSL locations, filled in once after a program
+ * is linked. Lookups hash the name in place and probe an open-addressed table, so
+ * they never allocate and a miss costs no more than a hit.
+ */
+class LocationTable {
+  struct Slot {
+    uint64_t hash;
+    GLint location;
+    int name;
+  };
+
+  std::vector<Slot> _slots;
+  std::vector<char> _names;
+  int _count;
+  uint64_t _mask;
+
+  void grow();
+
+public:
+  /**
+   * Creates an empty table.
+   */
+  LocationTable();
+
+  /**
+   * Hashes a NUL-terminated name the same way the table does.
+   * @param name the name to hash
+   * @return the hash
+   */
+  static uint64_t hash(const char* name);
+
+  /**
+   * Adds a name, or replaces its location if it is already in the table.
+   * @param name the name to add
+   * @param location the location of the name
+   */
+  void insert(const char* name, GLint location);
+
+  /**
+   * Looks up the location of a name.
+   * @param name the name to look up
+   * @return the location, or -1 if the name is not in the table
+   */
+  GLint find(const char* name) const;
+
+  /**
+   * Returns the number of names in the table.
+   * @return the number of names
+   */
+  int size() const;
+
+  /**
+   * Removes every name.
+   */
+  void clear();
+};
+
+#endif
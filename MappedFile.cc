@@ -0,0 +1,92 @@
+#include "MappedFile.h"
+#include "Exceptions.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char* fileName) :
+  _data(NULL), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(NULL) {
+  _file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (_file == INVALID_HANDLE_VALUE) {
+    throw IOError(string("Could not open ") + fileName);
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(_file, &fileSize)) {
+    CloseHandle(_file);
+    throw IOError(string("Could not get the size of ") + fileName);
+  }
+  _size = (size_t)fileSize.QuadPart;
+
+  if (_size > 0) {
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping != NULL) {
+      _data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (_data == NULL) {
+      if (_mapping != NULL) CloseHandle(_mapping);
+      CloseHandle(_file);
+      throw IOError(string("Could not map ") + fileName);
+    }
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (_data != NULL) UnmapViewOfFile(_data);
+  if (_mapping != NULL) CloseHandle(_mapping);
+  CloseHandle(_file);
+}
+
+#else
+
+MappedFile::MappedFile(const char* fileName) : _data(NULL), _size(0) {
+  int fd = open(fileName, O_RDONLY);
+  if (fd == -1) {
+    throw IOError(string("Could not open ") + fileName);
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    close(fd);
+    throw IOError(string("Could not get the size of ") + fileName);
+  }
+  _size = (size_t)fileStat.st_size;
+
+  if (_size > 0) {
+    void* mapped = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      throw IOError(string("Could not map ") + fileName);
+    }
+    _data = (const unsigned char*)mapped;
+  }
+
+  // The mapping keeps the file alive on its own.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (_data != NULL) munmap((void*)_data, _size);
+}
+
+#endif
+
+const unsigned char* MappedFile::data() const {
+  return _data;
+}
+
+size_t MappedFile::size() const {
+  return _size;
+}
@@ -0,0 +1,47 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <cstddef>
+
+/**
+ * A read-only view of a whole file mapped into memory.
+ * The mapping is released when the object is destroyed.
+ */
+class MappedFile {
+  const unsigned char* _data;
+  size_t _size;
+#ifdef _WIN32
+  void* _file;
+  void* _mapping;
+#endif
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+public:
+  /**
+   * Maps the given file into memory.
+   * @param fileName the path to the file
+   * @throws IOError if the file could not be opened or mapped
+   */
+  explicit MappedFile(const char* fileName);
+
+  /**
+   * Unmaps the file.
+   */
+  ~MappedFile();
+
+  /**
+   * Returns the first byte of the file, or NULL if the file is empty.
+   * @return the file contents
+   */
+  const unsigned char* data() const;
+
+  /**
+   * Returns the size of the file, in bytes.
+   * @return the file size
+   */
+  size_t size() const;
+};
+
+#endif
@@ -0,0 +1,777 @@
+#include "Mesh.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "Exceptions.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+// Marks the end of a chain of vertices sharing a position.
+static const GLuint NO_VERTEX = 0xFFFFFFFF;
+// Items per chunk when computing normals.
+static const int NORMAL_GRAIN = 16384;
+// Mantissa digits beyond this many do not change a float.
+static const int MAX_DIGITS = 19;
+
+static MeshError parseError(const char* fileName, int line, const char* message) {
+  return MeshError(string(fileName) + ":" + to_string(line) + ": " + message);
+}
+
+static bool isWord(const char* begin, size_t length, const char* word) {
+  return strlen(word) == length && memcmp(begin, word, length) == 0;
+}
+
+/**
+ * Parses a decimal number such as "-1.5e3" without needing a terminating NUL,
+ * so that it can run directly on a mapped file.
+ * @param p the first character; moved past the number
+ * @return whether there was a number
+ */
+static bool parseNumber(const char*& p, const char* end, double& value) {
+  static const double POWERS[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+    1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char* start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  
+  // Leading zeros do not count towards the digits kept.
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  for (; p < end && isdigit((unsigned char)*p); p++) {
+    any = true;
+    if (digits < MAX_DIGITS) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa > 0);
+    }
+    else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    p++;
+    for (; p < end && isdigit((unsigned char)*p); p++) {
+      any = true;
+      if (digits < MAX_DIGITS) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa > 0);
+        exponent--;
+      }
+    }
+  }
+  if (!any) {
+    p = start;
+    return false;
+  }
+  
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* mark = p++;
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = (*p == '-');
+      p++;
+    }
+    if (p < end && isdigit((unsigned char)*p)) {
+      int e = 0;
+      for (; p < end && isdigit((unsigned char)*p); p++) {
+        e = min(e * 10 + (*p - '0'), 10000);
+      }
+      exponent += negativeExponent ? -e : e;
+    }
+    else {
+      // Not an exponent after all, e.g. "1e" followed by a space.
+      p = mark;
+    }
+  }
+  
+  double result = (double)mantissa;
+  if (exponent < 0) {
+    result = (exponent >= -22) ? result / POWERS[-exponent] :
+      result * pow(10.0, exponent);
+  }
+  else if (exponent > 0) {
+    result = (exponent <= 22) ? result * POWERS[exponent] :
+      result * pow(10.0, exponent);
+  }
+  value = negative ? -result : result;
+  return true;
+}
+
+static bool parseInteger(const char*& p, const char* end, long long& value) {
+  const char* start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p >= end || !isdigit((unsigned char)*p)) {
+    p = start;
+    return false;
+  }
+  long long result = 0;
+  for (; p < end && isdigit((unsigned char)*p); p++) {
+    result = min(result * 10 + (*p - '0'), 1LL << 40);
+  }
+  value = negative ? -result : result;
+  return true;
+}
+
+namespace {
+  /**
+   * Reads tokens from a file in memory without copying it. Reads stop at the end
+   * of a line; nextLine() moves on to the next one.
+   */
+  class Tokenizer {
+    const char* _p;
+    const char* _end;
+    int _line;
+  
+  public:
+    Tokenizer(const char* begin, const char* end) :
+      _p(begin), _end(end), _line(1) {}
+  
+    bool atEnd() const {
+      return _p >= _end;
+    }
+  
+    bool atLineEnd() {
+      skipSpaces();
+      return _p >= _end || *_p == '\n' || *_p == '#';
+    }
+  
+    int line() const {
+      return _line;
+    }
+  
+    const char* position() const {
+      return _p;
+    }
+  
+    void skipSpaces() {
+      while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\r')) {
+        _p++;
+      }
+    }
+  
+    /**
+     * Skips spaces and newlines alike, for formats that are not line-based.
+     */
+    void skipWhitespace() {
+      while (_p < _end && isspace((unsigned char)*_p)) {
+        _line += (*_p == '\n');
+        _p++;
+      }
+    }
+  
+    void nextLine() {
+      const char* newline = (const char*)memchr(_p, '\n', _end - _p);
+      if (newline) {
+        _p = newline + 1;
+        _line++;
+      }
+      else {
+        _p = _end;
+      }
+    }
+  
+    /**
+     * Reads the next run of non-space characters on this line.
+     * @return whether there was one
+     */
+    bool token(const char*& begin, size_t& length) {
+      skipSpaces();
+      begin = _p;
+      while (_p < _end && !isspace((unsigned char)*_p)) {
+        _p++;
+      }
+      length = _p - begin;
+      return length > 0;
+    }
+  
+    bool number(double& value) {
+      skipSpaces();
+      return parseNumber(_p, _end, value);
+    }
+  
+    bool number(float& value) {
+      double d;
+      if (!number(d)) {
+        return false;
+      }
+      value = (float)d;
+      return true;
+    }
+  
+    /**
+     * Reads an integer right at the current position, e.g. within "1/2/3".
+     */
+    bool integer(long long& value) {
+      return parseInteger(_p, _end, value);
+    }
+  
+    bool accept(char c) {
+      if (_p < _end && *_p == c) {
+        _p++;
+        return true;
+      }
+      return false;
+    }
+  };
+  
+  enum PlyType {
+    PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32,
+    PLY_FLOAT32, PLY_FLOAT64
+  };
+  
+  // The bytes a binary value of each type takes.
+  size_t plySize(PlyType type) {
+    static const size_t SIZES[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    return SIZES[type];
+  }
+  
+  // What a property means to the mesh; everything else is skipped.
+  enum PlyRole {
+    PLY_OTHER, PLY_X, PLY_Y, PLY_Z, PLY_U, PLY_V, PLY_INDICES
+  };
+  
+  struct PlyProperty {
+    PlyType type;
+    PlyType countType;
+    bool list;
+    PlyRole role;
+  };
+  
+  struct PlyElement {
+    string name;
+    size_t count;
+    vector<PlyProperty> properties;
+  };
+  
+  /**
+   * Reads PLY values in the file's format, converting them to double.
+   */
+  class PlyReader {
+    Tokenizer& _text;
+    const unsigned char* _p;
+    const unsigned char* _end;
+    bool _ascii;
+    bool _swap;
+  
+  public:
+    PlyReader(Tokenizer& text, const char* end, bool ascii, bool swap) :
+      _text(text), _p((const unsigned char*)text.position()),
+      _end((const unsigned char*)end), _ascii(ascii), _swap(swap) {}
+  
+    bool read(PlyType type, double& value) {
+      if (_ascii) {
+        _text.skipWhitespace();
+        return _text.number(value);
+      }
+  
+      const size_t size = plySize(type);
+      if ((size_t)(_end - _p) < size) {
+        return false;
+      }
+      unsigned char bytes[8];
+      memcpy(bytes, _p, size);
+      if (_swap) {
+        reverse(bytes, bytes + size);
+      }
+      _p += size;
+  
+      switch (type) {
+        case PLY_INT8: { int8_t v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_UINT8: { uint8_t v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_INT16: { int16_t v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_INT32: { int32_t v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_FLOAT32: { float v; memcpy(&v, bytes, size); value = v; break; }
+        case PLY_FLOAT64: { memcpy(&value, bytes, size); break; }
+      }
+      return true;
+    }
+  
+    /**
+     * Reads a property that the mesh does not use.
+     */
+    bool skip(const PlyProperty& property) {
+      double value;
+      if (!property.list) {
+        return read(property.type, value);
+      }
+      if (!read(property.countType, value)) {
+        return false;
+      }
+      for (long long i = (long long)value; i > 0; i--) {
+        double item;
+        if (!read(property.type, item)) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+}
+
+static bool plyType(const char* word, size_t length, PlyType& type) {
+  static const struct {
+    const char* name;
+    PlyType type;
+  } NAMES[] = {
+    { "char", PLY_INT8 }, { "int8", PLY_INT8 },
+    { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+    { "short", PLY_INT16 }, { "int16", PLY_INT16 },
+    { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+    { "int", PLY_INT32 }, { "int32", PLY_INT32 },
+    { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+    { "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 },
+    { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+  };
+  for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+    if (isWord(word, length, NAMES[i].name)) {
+      type = NAMES[i].type;
+      return true;
+    }
+  }
+  return false;
+}
+
+static PlyRole plyRole(const string& element, const char* word, size_t length) {
+  if (element == "vertex") {
+    if (isWord(word, length, "x")) return PLY_X;
+    if (isWord(word, length, "y")) return PLY_Y;
+    if (isWord(word, length, "z")) return PLY_Z;
+    if (isWord(word, length, "u") || isWord(word, length, "s") ||
+        isWord(word, length, "texture_u") || isWord(word, length, "texture_s")) {
+      return PLY_U;
+    }
+    if (isWord(word, length, "v") || isWord(word, length, "t") ||
+        isWord(word, length, "texture_v") || isWord(word, length, "texture_t")) {
+      return PLY_V;
+    }
+  }
+  else if (element == "face") {
+    if (isWord(word, length, "vertex_indices") ||
+        isWord(word, length, "vertex_index")) {
+      return PLY_INDICES;
+    }
+  }
+  return PLY_OTHER;
+}
+
+/**
+ * Finds the fewest bytes an element can take. Binary values have a fixed size and
+ * ASCII ones take at least a digit; lists may be empty, so only their counts are
+ * sure to be there. An element without properties is taken as one byte, so that
+ * its count is checked too.
+ */
+static size_t plyMinimumSize(const PlyElement& element, bool ascii) {
+  size_t bytes = 0;
+  for (const PlyProperty& property : element.properties) {
+    bytes += ascii ? 1 : plySize(property.list ? property.countType : property.type);
+  }
+  return max(bytes, (size_t)1);
+}
+
+Mesh::Mesh(const char* fileName, WorkerPool& pool) : _positions(0) {
+  MappedFile file(fileName);
+  const char* begin = (const char*)file.data();
+  const char* end = begin + file.size();
+  if (file.size() >= 3 && memcmp(begin, "ply", 3) == 0) {
+    loadPly(begin, end, fileName);
+  }
+  else {
+    loadObj(begin, end, fileName);
+  }
+  
+  if (_indices.empty()) {
+    throw MeshError(string(fileName) + " holds no triangles");
+  }
+  computeNormals(pool);
+}
+
+void Mesh::loadObj(const char* begin, const char* end, const char* fileName) {
+  Tokenizer in(begin, end);
+  vector<glm::vec3> positions;
+  vector<glm::vec2> texCoords;
+  // Per position, the last vertex made from it; per vertex, the one before it
+  // with the same position and its texture coordinate index.
+  vector<GLuint> lastVertex;
+  vector<GLuint> previousVertex;
+  vector<GLint> vertexTexCoords;
+  vector<GLuint> polygon;
+  
+  while (!in.atEnd()) {
+    const char* word;
+    size_t length;
+    if (!in.token(word, length)) {
+      // An empty line.
+    }
+    else if (isWord(word, length, "v")) {
+      glm::vec3 position;
+      if (!in.number(position.x) || !in.number(position.y) ||
+          !in.number(position.z)) {
+        throw parseError(fileName, in.line(), "bad vertex position");
+      }
+      positions.push_back(position);
+      lastVertex.push_back(NO_VERTEX);
+    }
+    else if (isWord(word, length, "vt")) {
+      glm::vec2 texCoord(0.0f);
+      if (!in.number(texCoord.x)) {
+        throw parseError(fileName, in.line(), "bad texture coordinate");
+      }
+      in.number(texCoord.y);
+      texCoords.push_back(texCoord);
+    }
+    else if (isWord(word, length, "f")) {
+      polygon.clear();
+      while (!in.atLineEnd()) {
+        // Corners are "p", "p/t", "p//n" or "p/t/n", counted from 1, or from the
+        // end if negative. Normals are recomputed, so n is ignored.
+        long long p;
+        long long t = 0;
+        long long n;
+        if (!in.integer(p)) {
+          throw parseError(fileName, in.line(), "bad face");
+        }
+        if (in.accept('/')) {
+          in.integer(t);
+          if (in.accept('/')) {
+            in.integer(n);
+          }
+        }
+  
+        long long position = (p < 0) ? (long long)positions.size() + p : p - 1;
+        long long texCoord = (t < 0) ? (long long)texCoords.size() + t : t - 1;
+        if (position < 0 || position >= (long long)positions.size() ||
+            (t != 0 && (texCoord < 0 || texCoord >= (long long)texCoords.size()))) {
+          throw parseError(fileName, in.line(), "face index out of range");
+        }
+  
+        // Reuse the vertex if this position already appeared with this texture
+        // coordinate. The chains are as long as a position has UV seams.
+        GLuint vertex = lastVertex[position];
+        while (vertex != NO_VERTEX && vertexTexCoords[vertex] != (GLint)texCoord) {
+          vertex = previousVertex[vertex];
+        }
+        if (vertex == NO_VERTEX) {
+          vertex = (GLuint)_vertices.size();
+          FurAttributes f;
+          f.xyzPosition = positions[position];
+          f.xyzNormal = glm::vec3(0.0f);
+          f.uvTexCoord = (t != 0) ? texCoords[texCoord] : glm::vec2(0.0f);
+          f.layer = 0.0f;
+          _vertices.push_back(f);
+          _vertexPositions.push_back((GLuint)position);
+          vertexTexCoords.push_back((GLint)texCoord);
+          previousVertex.push_back(lastVertex[position]);
+          lastVertex[position] = vertex;
+        }
+        polygon.push_back(vertex);
+      }
+      if (polygon.size() < 3) {
+        throw parseError(fileName, in.line(), "face with fewer than 3 corners");
+      }
+      for (size_t i = 2; i < polygon.size(); i++) {
+        _indices.push_back(polygon[0]);
+        _indices.push_back(polygon[i - 1]);
+        _indices.push_back(polygon[i]);
+      }
+    }
+    in.nextLine();
+  }
+  
+  _positions = positions.size();
+  if (texCoords.empty()) {
+    projectTexCoords();
+  }
+}
+
+void Mesh::loadPly(const char* begin, const char* end, const char* fileName) {
+  Tokenizer in(begin, end);
+  const char* word;
+  size_t length;
+  if (!in.token(word, length) || !isWord(word, length, "ply")) {
+    throw parseError(fileName, in.line(), "not a PLY file");
+  }
+  in.nextLine();
+  
+  bool ascii = false;
+  bool bigEndian = false;
+  bool hasFormat = false;
+  vector<PlyElement> elements;
+  while (true) {
+    if (in.atEnd()) {
+      throw parseError(fileName, in.line(), "no end_header");
+    }
+    if (!in.token(word, length) || isWord(word, length, "comment") ||
+        isWord(word, length, "obj_info")) {
+      // Nothing to read.
+    }
+    else if (isWord(word, length, "end_header")) {
+      in.nextLine();
+      break;
+    }
+    else if (isWord(word, length, "format")) {
+      in.token(word, length);
+      ascii = isWord(word, length, "ascii");
+      bigEndian = isWord(word, length, "binary_big_endian");
+      if (!ascii && !bigEndian && !isWord(word, length, "binary_little_endian")) {
+        throw parseError(fileName, in.line(), "unknown PLY format");
+      }
+      hasFormat = true;
+    }
+    else if (isWord(word, length, "element")) {
+      PlyElement element;
+      double count;
+      // No count can exceed the file's size, which keeps the conversion defined.
+      if (!in.token(word, length) || !in.number(count) || count < 0.0 ||
+          count > (double)(end - begin)) {
+        throw parseError(fileName, in.line(), "bad element");
+      }
+      element.name.assign(word, length);
+      element.count = (size_t)count;
+      elements.push_back(element);
+    }
+    else if (isWord(word, length, "property")) {
+      if (elements.empty()) {
+        throw parseError(fileName, in.line(), "property outside an element");
+      }
+      PlyProperty property;
+      property.list = false;
+      property.countType = PLY_UINT8;
+      bool valid = in.token(word, length);
+      if (valid && isWord(word, length, "list")) {
+        property.list = true;
+        valid = in.token(word, length) && plyType(word, length, property.countType) &&
+          in.token(word, length);
+      }
+      valid = valid && plyType(word, length, property.type) &&
+        in.token(word, length);
+      if (!valid) {
+        throw parseError(fileName, in.line(), "bad property");
+      }
+      property.role = plyRole(elements.back().name, word, length);
+      if (property.list != (property.role == PLY_INDICES)) {
+        property.role = PLY_OTHER;
+      }
+      elements.back().properties.push_back(property);
+    }
+    else {
+      throw parseError(fileName, in.line(), "unknown header line");
+    }
+    in.nextLine();
+  }
+  if (!hasFormat) {
+    throw parseError(fileName, in.line(), "no format");
+  }
+  
+  // The counts size the buffers below, so one that the rest of the file cannot
+  // hold is rejected here rather than allocated for.
+  size_t available = end - in.position();
+  for (const PlyElement& element : elements) {
+    const size_t bytes = plyMinimumSize(element, ascii);
+    if (element.count > available / bytes) {
+      throw parseError(fileName, in.line(), "element count exceeds the file size");
+    }
+    available -= element.count * bytes;
+  }
+  
+  // Binary data is stored in the file's byte order, which need not be ours.
+  const uint16_t one = 1;
+  const bool littleEndianHost = *(const unsigned char*)&one == 1;
+  PlyReader reader(in, end, ascii, bigEndian == littleEndianHost);
+  
+  // PLY vertices already carry their texture coordinates, so each is its own
+  // position for the normals.
+  bool hasTexCoords = false;
+  vector<GLuint> polygon;
+  for (const PlyElement& element : elements) {
+    const bool vertices = (element.name == "vertex");
+    const bool faces = (element.name == "face");
+    if (vertices) {
+      _vertices.resize(element.count);
+    }
+    else if (faces) {
+      _indices.reserve(_indices.size() + element.count * 3);
+    }
+  
+    for (size_t i = 0; i < element.count; i++) {
+      glm::vec3 position(0.0f);
+      glm::vec2 texCoord(0.0f);
+      for (const PlyProperty& property : element.properties) {
+        double value;
+        bool valid;
+        if (property.role == PLY_OTHER) {
+          valid = reader.skip(property);
+        }
+        else if (property.role == PLY_INDICES) {
+          valid = reader.read(property.countType, value);
+          polygon.clear();
+          for (long long corner = (long long)value; valid && corner > 0; corner--) {
+            double index;
+            valid = reader.read(property.type, index);
+            polygon.push_back((GLuint)index);
+          }
+        }
+        else {
+          valid = reader.read(property.type, value);
+          switch (property.role) {
+            case PLY_X: position.x = (float)value; break;
+            case PLY_Y: position.y = (float)value; break;
+            case PLY_Z: position.z = (float)value; break;
+            case PLY_U: texCoord.x = (float)value; hasTexCoords = true; break;
+            case PLY_V: texCoord.y = (float)value; break;
+            default: break;
+          }
+        }
+        if (!valid) {
+          throw parseError(fileName, in.line(), "truncated element data");
+        }
+      }
+  
+      if (vertices) {
+        FurAttributes& f = _vertices[i];
+        f.xyzPosition = position;
+        f.xyzNormal = glm::vec3(0.0f);
+        f.uvTexCoord = texCoord;
+        f.layer = 0.0f;
+      }
+      else if (faces && polygon.size() >= 3) {
+        for (size_t corner = 2; corner < polygon.size(); corner++) {
+          _indices.push_back(polygon[0]);
+          _indices.push_back(polygon[corner - 1]);
+          _indices.push_back(polygon[corner]);
+        }
+      }
+    }
+  }
+  
+  for (GLuint index : _indices) {
+    if (index >= _vertices.size()) {
+      throw MeshError(string(fileName) + ": face index out of range");
+    }
+  }
+  _positions = _vertices.size();
+  if (!hasTexCoords) {
+    projectTexCoords();
+  }
+}
+
+static void bounds(const vector<FurAttributes>& vertices, glm::vec3& low,
+  glm::vec3& high) {
+  low = high = vertices.empty() ? glm::vec3(0.0f) : vertices[0].xyzPosition;
+  for (const FurAttributes& f : vertices) {
+    low = glm::min(low, f.xyzPosition);
+    high = glm::max(high, f.xyzPosition);
+  }
+}
+
+void Mesh::projectTexCoords() {
+  glm::vec3 low, high;
+  bounds(_vertices, low, high);
+  glm::vec3 extent = high - low;
+  
+  // Project along the thinnest axis, keeping the aspect ratio of the other two.
+  int thinnest = 0;
+  for (int axis = 1; axis < 3; axis++) {
+    if (extent[axis] < extent[thinnest]) {
+      thinnest = axis;
+    }
+  }
+  const int u = (thinnest == 0) ? 1 : 0;
+  const int v = (thinnest == 2) ? 1 : 2;
+  const float scale = 1.0f / max(max(extent[u], extent[v]), 1e-6f);
+  for (FurAttributes& f : _vertices) {
+    f.uvTexCoord = glm::vec2((f.xyzPosition[u] - low[u]) * scale,
+      (f.xyzPosition[v] - low[v]) * scale);
+  }
+}
+
+void Mesh::computeNormals(WorkerPool& pool) {
+  const int triangles = (int)(_indices.size() / 3);
+  const bool shared = !_vertexPositions.empty();
+  const GLuint* vertexPositions = shared ? &_vertexPositions[0] : NULL;
+  auto positionOf = [vertexPositions](GLuint vertex) {
+    return vertexPositions ? vertexPositions[vertex] : vertex;
+  };
+  
+  // The cross product's length is twice the triangle's area, so large faces
+  // weigh more.
+  vector<glm::vec3> faceNormals(triangles);
+  pool.parallelFor(triangles, NORMAL_GRAIN, [&](int begin, int end) {
+    for (int t = begin; t < end; t++) {
+      const glm::vec3& a = _vertices[_indices[t * 3]].xyzPosition;
+      const glm::vec3& b = _vertices[_indices[t * 3 + 1]].xyzPosition;
+      const glm::vec3& c = _vertices[_indices[t * 3 + 2]].xyzPosition;
+      faceNormals[t] = glm::cross(b - a, c - a);
+    }
+  });
+  
+  // List the faces around each position, so that every sum below has a single
+  // writer and needs no locking.
+  vector<GLuint> firstFace(_positions + 1, 0);
+  for (GLuint index : _indices) {
+    firstFace[positionOf(index) + 1]++;
+  }
+  for (size_t p = 0; p < _positions; p++) {
+    firstFace[p + 1] += firstFace[p];
+  }
+  vector<GLuint> faces(_indices.size());
+  vector<GLuint> next(firstFace.begin(), firstFace.end() - 1);
+  for (size_t i = 0; i < _indices.size(); i++) {
+    faces[next[positionOf(_indices[i])]++] = (GLuint)(i / 3);
+  }
+  
+  vector<glm::vec3> positionNormals(_positions);
+  pool.parallelFor((int)_positions, NORMAL_GRAIN, [&](int begin, int end) {
+    for (int p = begin; p < end; p++) {
+      glm::vec3 sum(0.0f);
+      for (GLuint f = firstFace[p]; f < firstFace[p + 1]; f++) {
+        sum += faceNormals[faces[f]];
+      }
+      // Unused or degenerate positions still need a direction to extrude along.
+      float length = glm::length(sum);
+      positionNormals[p] = (length > 0.0f) ? sum / length :
+        glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+  });
+  
+  pool.parallelFor((int)_vertices.size(), NORMAL_GRAIN, [&](int begin, int end) {
+    for (int v = begin; v < end; v++) {
+      _vertices[v].xyzNormal = positionNormals[positionOf(v)];
+    }
+  });
+}
+
+void Mesh::fit(const glm::vec3& center, float size) {
+  glm::vec3 low, high;
+  bounds(_vertices, low, high);
+  glm::vec3 extent = high - low;
+  float longest = max(max(extent.x, extent.y), extent.z);
+  float scale = (longest > 0.0f) ? size / longest : 1.0f;
+  glm::vec3 middle = (low + high) * 0.5f;
+  for (FurAttributes& f : _vertices) {
+    f.xyzPosition = (f.xyzPosition - middle) * scale + center;
+  }
+}
+
+const vector<FurAttributes>& Mesh::vertices() const {
+  return _vertices;
+}
+
+const vector<GLuint>& Mesh::indices() const {
+  return _indices;
+}
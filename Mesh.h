@@ -0,0 +1,74 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "FurGeometry.h"
+#include "WorkerPool.h"
+
+/**
+ * A triangle mesh read from a Wavefront OBJ or a PLY file, laid out for
+ * FurGeometry: vertices() and indices() can be passed to its indexed constructor
+ * as they are.
+ *
+ * The file is memory-mapped and tokenized in place. Faces with more than three
+ * corners are split into fans. Only positions and texture coordinates are read;
+ * normals are always recomputed, because the shells need them smooth. Meshes
+ * without texture coordinates get a planar projection along their thinnest axis.
+ */
+class Mesh {
+  std::vector<FurAttributes> _vertices;
+  std::vector<GLuint> _indices;
+  // The file's position each vertex came from. Vertices only split by texture
+  // coordinates share their position and thus their normal, so that the shells
+  // do not crack open along seams.
+  std::vector<GLuint> _vertexPositions;
+  size_t _positions;
+
+  Mesh(const Mesh&);
+  Mesh& operator=(const Mesh&);
+
+  void loadObj(const char* begin, const char* end, const char* fileName);
+  void loadPly(const char* begin, const char* end, const char* fileName);
+  void projectTexCoords();
+
+public:
+  /**
+   * Loads a mesh and computes its normals. PLY files are recognized by their
+   * header; anything else is read as OBJ.
+   * @param fileName the path to the file
+   * @param pool the threads to compute normals with
+   * @throws IOError if the file could not be read
+   * @throws MeshError if the file is malformed or holds no triangles
+   */
+  explicit Mesh(const char* fileName, WorkerPool& pool = WorkerPool::shared());
+
+  /**
+   * Recomputes smooth vertex normals, weighting each face by its area.
+   * @param pool the threads to compute with
+   */
+  void computeNormals(WorkerPool& pool = WorkerPool::shared());
+
+  /**
+   * Scales and moves the mesh so that its bounding box is centered on a point and
+   * its longest side has the given length.
+   * @param center the new center of the bounding box
+   * @param size the new length of the longest side
+   */
+  void fit(const glm::vec3& center, float size);
+
+  /**
+   * Returns the vertices, with normals and a layer of 0.
+   * @return the vertices
+   */
+  const std::vector<FurAttributes>& vertices() const;
+
+  /**
+   * Returns the triangle list, three indices per triangle.
+   * @return the indices
+   */
+  const std::vector<GLuint>& indices() const;
+};
+
+#endif
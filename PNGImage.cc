@@ -0,0 +1,222 @@
+#include "PNGImage.h"
+#include <cstdio>
+#include <cstring>
+#include "Exceptions.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+namespace {
+  /**
+   * The read position within an in-memory PNG.
+   */
+  struct PNGReadCursor {
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+  };
+}
+
+static void readFromMemory(png_structp pngRead, png_bytep out, png_size_t length) {
+  PNGReadCursor* cursor = (PNGReadCursor*)png_get_io_ptr(pngRead);
+  if (length > cursor->size - cursor->offset) {
+    png_error(pngRead, "Unexpected end of PNG data");
+  }
+  memcpy(out, cursor->data + cursor->offset, length);
+  cursor->offset += length;
+}
+
+PNGImage::PNGImage(const unsigned char* data, size_t size) {
+  decode(data, size);
+}
+
+PNGImage::PNGImage(const char* fileName) {
+  MappedFile file(fileName);
+  decode(file.data(), file.size());
+}
+
+PNGImage::PNGImage(int width, int height, int channels,
+  const shared_ptr<vector<png_byte>>& pixels)
+  : _width(width), _height(height), _channels(channels), _pixels(pixels) {}
+
+/**
+ * Decodes a PNG whose header has been checked into 8-bit RGB or RGBA pixels,
+ * bottom row first. libpng reports errors by longjmp()ing back here, which skips
+ * destructors and leaves the locals changed after setjmp() indeterminate, so
+ * this function owns no objects and everything it changes is the caller's.
+ * @return whether libpng succeeded
+ */
+static bool readPNG(png_structp pngRead, png_infop pngInfo,
+  PNGReadCursor* cursor, int& width, int& height, int& channels,
+  vector<png_byte>& pixels, vector<png_bytep>& rows) {
+  // This error-handling method is prescribed in the libpng manual.
+  if (setjmp(png_jmpbuf(pngRead))) {
+    return false;
+  }
+  
+  // Have libpng read straight out of memory. The header was checked above.
+  png_set_read_fn(pngRead, (png_voidp)cursor, readFromMemory);
+  png_set_sig_bytes(pngRead, 8);
+  
+  // Read the entire PNG header.
+  png_read_info(pngRead, pngInfo);
+  
+  png_uint_32 colorType = png_get_color_type(pngRead, pngInfo);
+  if (colorType & PNG_COLOR_MASK_PALETTE) {
+    png_set_palette_to_rgb(pngRead);
+  }
+  else if (!(colorType & PNG_COLOR_MASK_COLOR)) {
+    png_set_expand_gray_1_2_4_to_8(pngRead);
+    png_set_gray_to_rgb(pngRead);
+  }
+  
+  // Convert any transparency to a full alpha channel.
+  if (png_get_valid(pngRead, pngInfo, PNG_INFO_tRNS)) {
+    png_set_tRNS_to_alpha(pngRead);
+  }
+  
+  // Convert 16-bit precision to 8-bit precision.
+  if (png_get_bit_depth(pngRead, pngInfo) == 16) {
+    png_set_strip_16(pngRead);
+  }
+  
+  // Let libpng work out the final layout after the conversions above.
+  png_read_update_info(pngRead, pngInfo);
+  
+  width = png_get_image_width(pngRead, pngInfo);
+  height = png_get_image_height(pngRead, pngInfo);
+  channels = png_get_channels(pngRead, pngInfo);
+  const size_t stride = png_get_rowbytes(pngRead, pngInfo);
+  
+  // Decode straight into the final buffer, with the row pointers set
+  // "upside-down" so the bottom row comes first.
+  pixels.resize(stride * height);
+  rows.resize(height);
+  for (int row = 0; row < height; row++) {
+    rows[row] = pixels.data() + (size_t)(height - row - 1) * stride;
+  }
+  
+  // Actually read the image!
+  png_read_image(pngRead, rows.data());
+  return true;
+}
+
+void PNGImage::decode(const unsigned char* data, size_t size) {
+  // Check the PNG header (8 bytes).
+  if (size < 8 || png_sig_cmp((png_const_bytep)data, 0, 8)) {
+    throw PNGError("Bad PNG header");
+  }
+  
+  png_structp pngRead = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+    NULL, NULL, NULL);
+  if (!pngRead) {
+    throw PNGError("Could not initialize PNG read");
+  }
+  
+  png_infop pngInfo = png_create_info_struct(pngRead);
+  if (!pngInfo) {
+    png_destroy_read_struct(&pngRead, (png_infopp)NULL, (png_infopp)NULL);
+    throw PNGError("Could not initialize PNG info");
+  }
+  
+  shared_ptr<vector<png_byte>> pixels = make_shared<vector<png_byte>>();
+  vector<png_bytep> rows;
+  PNGReadCursor cursor = { data, size, 8 };
+  bool read;
+  try {
+    read = readPNG(pngRead, pngInfo, &cursor, _width, _height, _channels,
+      *pixels, rows);
+  }
+  catch (...) {
+    // Allocating the pixels can fail too.
+    png_destroy_read_struct(&pngRead, &pngInfo, (png_infopp)NULL);
+    throw;
+  }
+  png_destroy_read_struct(&pngRead, &pngInfo, (png_infopp)NULL);
+  if (!read) {
+    throw PNGError("Error occurred while reading PNG");
+  }
+  
+  _pixels = pixels;
+}
+
+vector<shared_ptr<PNGImage>> PNGImage::loadAll(const vector<string>& fileNames,
+  WorkerPool& pool) {
+  vector<shared_ptr<PNGImage>> images(fileNames.size());
+  
+  pool.parallelFor((int)fileNames.size(), 1, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      images[i] = make_shared<PNGImage>(fileNames[i].c_str());
+    }
+  });
+  
+  return images;
+}
+
+int PNGImage::width() const {
+  return _width;
+}
+
+int PNGImage::height() const {
+  return _height;
+}
+
+int PNGImage::channels() const {
+  return _channels;
+}
+
+GLenum PNGImage::format() const {
+  return (_channels == 4) ? GL_RGBA : GL_RGB;
+}
+
+const shared_ptr<vector<png_byte>>& PNGImage::pixels() const {
+  return _pixels;
+}
+
+void PNGImage::save(const char* fileName) const {
+  FILE* file = fopen(fileName, "wb");
+  if (!file) {
+    throw IOError(string("Could not open ") + fileName + " for writing");
+  }
+  
+  png_structp pngWrite = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+    NULL, NULL, NULL);
+  if (!pngWrite) {
+    fclose(file);
+    throw PNGError("Could not initialize PNG write");
+  }
+  
+  png_infop pngInfo = png_create_info_struct(pngWrite);
+  if (!pngInfo) {
+    png_destroy_write_struct(&pngWrite, (png_infopp)NULL);
+    fclose(file);
+    throw PNGError("Could not initialize PNG info");
+  }
+  
+  // The pixels are bottom row first, so hand libpng the rows "upside-down".
+  const size_t stride = (size_t)_width * _channels;
+  vector<png_bytep> rows(_height);
+  for (int row = 0; row < _height; row++) {
+    rows[row] = _pixels->data() + (size_t)(_height - row - 1) * stride;
+  }
+  
+  // This error-handling method is prescribed in the libpng manual.
+  if (setjmp(png_jmpbuf(pngWrite))) {
+    png_destroy_write_struct(&pngWrite, &pngInfo);
+    fclose(file);
+    throw PNGError("Error occurred while writing PNG");
+  }
+  
+  png_init_io(pngWrite, file);
+  png_set_IHDR(pngWrite, pngInfo, _width, _height, 8,
+    (_channels == 4) ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB,
+    PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(pngWrite, pngInfo);
+  png_write_image(pngWrite, rows.data());
+  png_write_end(pngWrite, NULL);
+  png_destroy_write_struct(&pngWrite, &pngInfo);
+  
+  if (fclose(file) != 0) {
+    throw IOError(string("Could not write ") + fileName);
+  }
+}
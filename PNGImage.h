@@ -0,0 +1,107 @@
+#ifndef _PNGIMAGE_H_
+#define _PNGIMAGE_H_
+
+#include <GL/glew.h>
+#include <png.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "WorkerPool.h"
+
+/**
+ * A PNG decoded into 8-bit RGB or RGBA pixels, bottom row first as OpenGL expects.
+ * Decoding never touches OpenGL, so images can be decoded on worker threads and
+ * uploaded later on the thread that owns the context.
+ *
+ * The decoder reads from a contiguous block of memory, so any I/O backend that can
+ * produce one plugs in directly: a memory-mapped file, an in-memory buffer, or a
+ * section of a larger archive.
+ */
+class PNGImage {
+  int _width;
+  int _height;
+  int _channels;
+  std::shared_ptr<std::vector<png_byte>> _pixels;
+  void decode(const unsigned char* data, size_t size);
+
+public:
+  /**
+   * Decodes a PNG held in memory.
+   * @param data the PNG file contents
+   * @param size the number of bytes
+   * @throws PNGError if the PNG data was invalid or corrupt
+   */
+  PNGImage(const unsigned char* data, size_t size);
+
+  /**
+   * Memory-maps a PNG file and decodes it.
+   * @param fileName the path to the PNG file
+   * @throws IOError if the file could not be read
+   * @throws PNGError if the PNG data was invalid or corrupt
+   */
+  explicit PNGImage(const char* fileName);
+
+  /**
+   * Wraps pixels that are already decoded, e.g. read back from a framebuffer, so
+   * that they can be saved.
+   * @param width the width of the image, in pixels
+   * @param height the height of the image, in pixels
+   * @param channels the number of 8-bit channels per pixel (3 or 4)
+   * @param pixels tightly packed rows, bottom row first
+   */
+  PNGImage(int width, int height, int channels,
+    const std::shared_ptr<std::vector<png_byte>>& pixels);
+
+  /**
+   * Decodes several PNG files in parallel.
+   * @param fileNames the paths to the PNG files
+   * @param pool the threads to decode with
+   * @return the decoded images, in the same order as fileNames
+   * @throws IOError if one of the files could not be read
+   * @throws PNGError if one of the files was invalid or corrupt
+   */
+  static std::vector<std::shared_ptr<PNGImage>> loadAll(
+    const std::vector<std::string>& fileNames,
+    WorkerPool& pool = WorkerPool::shared());
+
+  /**
+   * Returns the width of the image, in pixels.
+   * @return the width of the image
+   */
+  int width() const;
+
+  /**
+   * Returns the height of the image, in pixels.
+   * @return the height of the image
+   */
+  int height() const;
+
+  /**
+   * Returns the number of 8-bit channels per pixel (3 or 4).
+   * @return the number of channels
+   */
+  int channels() const;
+
+  /**
+   * Returns the OpenGL pixel format matching channels() (GL_RGB or GL_RGBA).
+   * @return the OpenGL pixel format
+   */
+  GLenum format() const;
+
+  /**
+   * Returns the decoded pixels. Rows are tightly packed, bottom row first.
+   * @return the pixels
+   */
+  const std::shared_ptr<std::vector<png_byte>>& pixels() const;
+
+  /**
+   * Encodes the image as an 8-bit PNG file.
+   * @param fileName the path to write to
+   * @throws IOError if the file could not be opened
+   * @throws PNGError if the PNG could not be encoded
+   */
+  void save(const char* fileName) const;
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "Profiler.h"
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+Profiler::Scope::Scope(Profiler* profiler, const char* stage)
+  : _profiler(profiler) {
+  if (_profiler) {
+    _profiler->begin(stage);
+  }
+}
+
+Profiler::Scope::~Scope() {
+  if (_profiler) {
+    _profiler->end();
+  }
+}
+
+Profiler::Profiler(size_t history, int pools)
+  : _history(history), _pools(pools), _pool(0), _frames(0), _droppedFrames(0),
+    _tracing(false) {
+  assert(history > 0 && pools > 0);
+  for (Pool& pool : _pools) {
+    pool.used = 0;
+    pool.pending = false;
+  }
+  
+  // Both clocks are read back to back so that trace events line up.
+  glGetInteger64v(GL_TIMESTAMP, &_gpuStart);
+  _cpuStart = Clock::now();
+}
+
+Profiler::~Profiler() {
+  for (Pool& pool : _pools) {
+    if (!pool.queries.empty()) {
+      glDeleteQueries((GLsizei)pool.queries.size(), &pool.queries[0]);
+    }
+  }
+}
+
+int Profiler::stage(const char* name) {
+  for (size_t i = 0; i < _stages.size(); i++) {
+    if (_stages[i].name == name || strcmp(_stages[i].name, name) == 0) {
+      return (int)i;
+    }
+  }
+  
+  Stage stage;
+  stage.name = name;
+  stage.cpu.reserve(_history);
+  stage.gpu.reserve(_history);
+  stage.nextCpu = 0;
+  stage.nextGpu = 0;
+  _stages.push_back(stage);
+  return (int)_stages.size() - 1;
+}
+
+double Profiler::cpuNow() const {
+  chrono::duration<double, milli> elapsed = Clock::now() - _cpuStart;
+  return elapsed.count();
+}
+
+void Profiler::record(vector<double>& window, size_t& next, size_t history,
+  double ms) {
+  if (window.size() < history) {
+    window.push_back(ms);
+  }
+  else {
+    window[next] = ms;
+  }
+  next = (next + 1) % history;
+}
+
+void Profiler::collect(Pool& pool) {
+  if (!pool.pending) {
+    return;
+  }
+  pool.pending = false;
+  
+  // Queries complete in order, so the last one written tells whether all of them
+  // have. That is the end of the "frame" stage, which encloses every other stage
+  // and is closed last. A frame that is not done in time is dropped rather than
+  // waited for, since its pool is about to be reused.
+  GLint available = 0;
+  glGetQueryObjectiv(pool.queries[pool.samples[0].query + 1],
+    GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    _droppedFrames++;
+    return;
+  }
+  
+  for (const Sample& sample : pool.samples) {
+    GLuint64 begin, end;
+    glGetQueryObjectui64v(pool.queries[sample.query], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(pool.queries[sample.query + 1], GL_QUERY_RESULT, &end);
+    double ms = (end - begin) / 1e6;
+  
+    Stage& stage = _stages[sample.stage];
+    record(stage.gpu, stage.nextGpu, _history, ms);
+    if (_tracing) {
+      double start = ((GLint64)begin - _gpuStart) / 1e6;
+      TraceEvent event = { stage.name, true, start, ms };
+      _trace.push_back(event);
+    }
+  }
+}
+
+void Profiler::beginFrame() {
+  assert(_open.empty());
+  _pool = (_pool + 1) % _pools.size();
+  Pool& pool = _pools[_pool];
+  collect(pool);
+  pool.used = 0;
+  pool.samples.clear();
+  _frames++;
+  begin("frame");
+}
+
+void Profiler::endFrame() {
+  end();
+  assert(_open.empty());
+  _pools[_pool].pending = true;
+}
+
+void Profiler::begin(const char* name) {
+  Pool& pool = _pools[_pool];
+  // Queries are only created while the pools grow to the number of stages.
+  if (pool.used + 2 > (int)pool.queries.size()) {
+    pool.queries.resize(pool.used + 2);
+    glGenQueries(2, &pool.queries[pool.used]);
+  }
+  
+  Sample sample = { stage(name), cpuNow(), 0.0, pool.used };
+  glQueryCounter(pool.queries[pool.used], GL_TIMESTAMP);
+  pool.used += 2;
+  _open.push_back((int)pool.samples.size());
+  pool.samples.push_back(sample);
+}
+
+void Profiler::end() {
+  assert(!_open.empty());
+  Pool& pool = _pools[_pool];
+  Sample& sample = pool.samples[_open.back()];
+  _open.pop_back();
+  glQueryCounter(pool.queries[sample.query + 1], GL_TIMESTAMP);
+  sample.cpuEnd = cpuNow();
+  
+  Stage& stage = _stages[sample.stage];
+  double ms = sample.cpuEnd - sample.cpuBegin;
+  record(stage.cpu, stage.nextCpu, _history, ms);
+  if (_tracing) {
+    TraceEvent event = { stage.name, false, sample.cpuBegin, ms };
+    _trace.push_back(event);
+  }
+}
+
+void Profiler::setTracing(bool tracing) {
+  _tracing = tracing;
+}
+
+FrameReport::Stats Profiler::stats(const char* name, bool gpu) const {
+  for (const Stage& stage : _stages) {
+    if (strcmp(stage.name, name) == 0) {
+      vector<double> times = gpu ? stage.gpu : stage.cpu;
+      return FrameReport::summarize(times);
+    }
+  }
+  return FrameReport::Stats();
+}
+
+unsigned long long Profiler::droppedFrames() const {
+  return _droppedFrames;
+}
+
+void Profiler::writeStats(ostream& out) const {
+  streamsize precision = out.precision(3);
+  out << fixed;
+  out << "stage\tcpu min\tcpu avg\tcpu p99\tgpu min\tgpu avg\tgpu p99 (ms)\n";
+  for (const Stage& stage : _stages) {
+    FrameReport::Stats cpu = stats(stage.name, false);
+    FrameReport::Stats gpu = stats(stage.name, true);
+    out << stage.name << "\t" << cpu.min << "\t" << cpu.mean << "\t" << cpu.p99
+        << "\t" << gpu.min << "\t" << gpu.mean << "\t" << gpu.p99 << "\n";
+  }
+  out << _frames << " frames, " << _droppedFrames << " without GPU times\n";
+  out.unsetf(ios::floatfield);
+  out.precision(precision);
+}
+
+void Profiler::writeTrace(ostream& out) const {
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, "
+      << "\"args\": {\"name\": \"CPU\"}},\n";
+  out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, "
+      << "\"args\": {\"name\": \"GPU\"}}";
+  streamsize precision = out.precision(3);
+  out << fixed;
+  for (const TraceEvent& event : _trace) {
+    // Timestamps and durations are in microseconds.
+    out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, "
+        << "\"tid\": " << (event.gpu ? 2 : 1) << ", \"ts\": "
+        << event.begin * 1000.0 << ", \"dur\": " << event.duration * 1000.0
+        << "}";
+  }
+  out << "\n]}\n";
+  out.unsetf(ios::floatfield);
+  out.precision(precision);
+}
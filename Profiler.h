@@ -0,0 +1,157 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include <GL/glew.h>
+#include "FrameReport.h"
+
+/**
+ * Measures named stages of every frame on the CPU and on the GPU.
+ *
+ * CPU times come from a steady clock. GPU times come from GL_TIMESTAMP queries
+ * issued at the start and end of every stage. Each frame records its queries into
+ * its own pool and the pools are reused in turn; a pool's results are only read
+ * once they are available, and frames whose results are still pending when their
+ * pool comes round again are dropped instead of waiting on the GPU.
+ *
+ * Stages may nest. Stage names must outlive the profiler; string literals are
+ * expected.
+ */
+class Profiler {
+public:
+  /**
+   * Times one stage for as long as it is in scope. Does nothing if the profiler
+   * is NULL, so instrumented code does not need to check whether profiling is on.
+   */
+  class Scope {
+    Profiler* _profiler;
+
+    Scope(const Scope&);
+    Scope& operator=(const Scope&);
+
+  public:
+    Scope(Profiler* profiler, const char* stage);
+    ~Scope();
+  };
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Stage {
+    const char* name;
+    // Rolling windows of the latest times, in milliseconds.
+    std::vector<double> cpu;
+    std::vector<double> gpu;
+    size_t nextCpu;
+    size_t nextGpu;
+  };
+
+  struct Sample {
+    int stage;
+    double cpuBegin;
+    double cpuEnd;
+    int query;
+  };
+
+  struct Pool {
+    std::vector<GLuint> queries;
+    std::vector<Sample> samples;
+    int used;
+    bool pending;
+  };
+
+  struct TraceEvent {
+    const char* name;
+    bool gpu;
+    double begin;
+    double duration;
+  };
+
+  size_t _history;
+  std::vector<Stage> _stages;
+  std::vector<Pool> _pools;
+  int _pool;
+  std::vector<int> _open;
+  unsigned long long _frames;
+  unsigned long long _droppedFrames;
+  Clock::time_point _cpuStart;
+  GLint64 _gpuStart;
+  bool _tracing;
+  std::vector<TraceEvent> _trace;
+
+  Profiler(const Profiler&);
+  Profiler& operator=(const Profiler&);
+
+  int stage(const char* name);
+  double cpuNow() const;
+  void collect(Pool& pool);
+  static void record(std::vector<double>& window, size_t& next, size_t history,
+    double ms);
+
+public:
+  /**
+   * Creates the query pools. Needs a current OpenGL 3.3 context.
+   * @param history the number of frames the statistics cover
+   * @param pools the number of frames whose queries may be in flight at once
+   */
+  explicit Profiler(size_t history = 120, int pools = 2);
+  ~Profiler();
+
+  /**
+   * Starts a frame. Collects the GPU times of the oldest pool if they are
+   * available and starts timing the "frame" stage.
+   */
+  void beginFrame();
+
+  /**
+   * Ends the frame started by beginFrame().
+   */
+  void endFrame();
+
+  /**
+   * Starts timing a stage. Prefer Scope.
+   * @param name the stage name
+   */
+  void begin(const char* name);
+
+  /**
+   * Stops timing the most recently started stage.
+   */
+  void end();
+
+  /**
+   * Starts or stops keeping every event for writeTrace().
+   * @param tracing whether to keep events
+   */
+  void setTracing(bool tracing);
+
+  /**
+   * Summarizes the CPU or GPU times of a stage over the latest frames.
+   * @param name the stage name
+   * @param gpu whether to summarize GPU times rather than CPU times
+   * @return the statistics; all zero if the stage has no times yet
+   */
+  FrameReport::Stats stats(const char* name, bool gpu) const;
+
+  /**
+   * Returns the number of frames whose GPU times were dropped because their
+   * queries were still pending.
+   * @return the number of dropped frames
+   */
+  unsigned long long droppedFrames() const;
+
+  /**
+   * Writes a table of rolling min/avg/p99 CPU and GPU times for every stage.
+   */
+  void writeStats(std::ostream& out) const;
+
+  /**
+   * Writes the kept events in the Chrome trace event format, for
+   * chrome://tracing or Perfetto. CPU and GPU stages appear as separate threads.
+   */
+  void writeTrace(std::ostream& out) const;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _RGBCOLOR_H_
+#define _RGBCOLOR_H_
+
+/**
+ * An 8-bit-per-channel RGBA color, laid out as in a GL_RGBA/GL_UNSIGNED_BYTE
+ * texture.
+ */
+struct RGBColor {
+  unsigned char r;
+  unsigned char g;
+  unsigned char b;
+  unsigned char a;
+  
+  RGBColor() : r(0), g(0), b(0), a(0) {}
+  RGBColor(unsigned char rr, unsigned char gg, unsigned char bb, unsigned char aa) :
+    r(rr), g(gg), b(bb), a(aa) {}
+};
+
+#endif
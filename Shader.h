@@ -9,6 +9,20 @@
 
 using namespace std;
 
+/**
+ * Reads a GLSL shader text file.
+ * @param fileName the path to the GLSL shader text file
+ * @return the shader source
+ * @throws ifstream::failure if the shader text file could not be read
+ */
+inline string readShaderSource(const char* fileName) {
+  ifstream shaderFile;
+  shaderFile.exceptions(ifstream::failbit | ifstream::badbit);
+  shaderFile.open(fileName, ios::binary);
+  return string((istreambuf_iterator<char>(shaderFile)),
+    istreambuf_iterator<char>());
+}
+
 /**
  * A GLSL shader loaded from disk.
  */
@@ -16,24 +30,12 @@ template <GLenum shaderType>
 class Shader {
   GLuint _shader;
   
-public:
-  /**
-   * Constructs a new shader by loading it from disk.
-   * The constructor will automatically compile the GLSL shader.
-   * @param fileName the path to the GLSL shader text file
-   * @throws ifstream::failure if the shader text file could not be read
-   * @throws GLSLError if there was a GLSL compilation error
-   */
-  Shader(const char* fileName) {
+  Shader() : _shader(0) {}
+  
+  void compile(const string& shaderText) {
     GLuint shaderId = 0;
     
-    ifstream shaderFile;
-    shaderFile.exceptions(ifstream::failbit | ifstream::badbit);
-    
     try {
-      shaderFile.open(fileName, ios::binary);
-      string shaderText((istreambuf_iterator<char>(shaderFile)),
-        istreambuf_iterator<char>());
       const char* shaderCString = shaderText.c_str();
     
       shaderId = glCreateShader(shaderType);
@@ -60,6 +62,30 @@ public:
     }
   }
   
+public:
+  /**
+   * Constructs a new shader by loading it from disk.
+   * The constructor will automatically compile the GLSL shader.
+   * @param fileName the path to the GLSL shader text file
+   * @throws ifstream::failure if the shader text file could not be read
+   * @throws GLSLError if there was a GLSL compilation error
+   */
+  Shader(const char* fileName) {
+    compile(readShaderSource(fileName));
+  }
+  
+  /**
+   * Constructs a new shader from GLSL source text that is already in memory.
+   * @param shaderText the GLSL source
+   * @return the compiled shader
+   * @throws GLSLError if there was a GLSL compilation error
+   */
+  static Shader fromSource(const string& shaderText) {
+    Shader shader;
+    shader.compile(shaderText);
+    return shader;
+  }
+  
   /**
    * Indicates whether the shader is available for use.
    * If this is true, then the shader was compiled and is ready to be used.
@@ -104,4 +130,9 @@ typedef Shader<GL_FRAGMENT_SHADER> FragmentShader;
  */
 typedef Shader<GL_GEOMETRY_SHADER> GeometryShader;
 
+/**
+ * A GLSL compute shader. Requires OpenGL 4.3.
+ */
+typedef Shader<GL_COMPUTE_SHADER> ComputeShader;
+
 #endif
@@ -1,8 +1,61 @@
 #include "ShaderProgram.h"
-#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 #include "Exceptions.h"
 
 using namespace boost;
+using namespace std::chrono;
+
+namespace {
+  /**
+   * The header of a cached program binary.
+   */
+  struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint32_t binarySize;
+    double compileSeconds;
+  };
+  
+  const char* PROGRAM_CACHE_EXTENSION = ".glprog";
+  
+  uint64_t hashString(const string& text, uint64_t seed) {
+    // Hash the length too, so that moving text between sources changes the key.
+    uint64_t size = text.size();
+    seed = FileCache::hash(&size, sizeof(size), seed);
+    return FileCache::hash(text.data(), text.size(), seed);
+  }
+  
+  uint64_t hashGLString(GLenum name, uint64_t seed) {
+    const GLubyte* value = glGetString(name);
+    return hashString(value ? string((const char*)value) : string(), seed);
+  }
+  
+  /**
+   * Hashes the shader sources together with the driver strings; a binary is only
+   * valid for the exact driver that produced it.
+   */
+  uint64_t programKey(const string& vsText, const string& fsText,
+                      const string& gsText) {
+    uint64_t key = hashString(vsText, FileCache::hash(NULL, 0));
+    key = hashString(fsText, key);
+    key = hashString(gsText, key);
+    key = hashGLString(GL_VENDOR, key);
+    key = hashGLString(GL_RENDERER, key);
+    key = hashGLString(GL_VERSION, key);
+    return hashGLString(GL_SHADING_LANGUAGE_VERSION, key);
+  }
+  
+  double secondsSince(steady_clock::time_point start) {
+    return duration<double>(steady_clock::now() - start).count();
+  }
+}
+
+ShaderProgram::CacheStats ShaderProgram::_cacheStats = { 0, 0, 0.0 };
 
 ShaderProgram::ShaderProgram(VertexShader vs,
                              FragmentShader fs,
@@ -10,32 +63,173 @@ ShaderProgram::ShaderProgram(VertexShader vs,
   init(vs, fs, gs);
 }
 
+ShaderProgram::ShaderProgram(ComputeShader cs) {
+  GLuint programId = 0;
+  
+  try {
+    if (!cs.valid()) {
+      throw ShaderError("The compute shader is invalid");
+    }
+    
+    programId = glCreateProgram();
+    glAttachShader(programId, cs.shaderId());
+    link(programId);
+    glDetachShader(programId, cs.shaderId());
+    
+    _program = programId;
+    reflect();
+  }
+  catch (...) {
+    if (programId != 0) glDeleteProgram(programId);
+    throw;
+  }
+}
+
 ShaderProgram::ShaderProgram(const char* vsFileName,
                              const char* fsFileName,
-                             const char* gsFileName) {
-  VertexShader vs(vsFileName);
-  FragmentShader fs(fsFileName);
+                             const char* gsFileName,
+                             FileCache* cache) {
+  string vsText = readShaderSource(vsFileName);
+  string fsText = readShaderSource(fsFileName);
+  string gsText;
+  if (strlen(gsFileName) != 0) {
+    gsText = readShaderSource(gsFileName);
+  }
+  
+  const bool useCache = cache && supportsBinaries();
+  uint64_t key = 0;
+  if (useCache) {
+    key = programKey(vsText, fsText, gsText);
+    std::shared_ptr<MappedFile> cached = cache->load(key, PROGRAM_CACHE_EXTENSION);
+    if (cached && loadBinary(*cached)) {
+      return;
+    }
+  }
+  
+  steady_clock::time_point start = steady_clock::now();
+  
+  VertexShader vs = VertexShader::fromSource(vsText);
+  FragmentShader fs = FragmentShader::fromSource(fsText);
   
   optional<GeometryShader> gs;
-  if (strlen(gsFileName) == 0) {
+  if (gsText.empty()) {
     gs = optional<GeometryShader>();
   }
   else {
-    gs = optional<GeometryShader>(GeometryShader(gsFileName));
+    gs = optional<GeometryShader>(GeometryShader::fromSource(gsText));
   }
   
-  init(vs, fs, gs);
+  init(vs, fs, gs, useCache);
   
   vs.destroy();
   fs.destroy();
   if (gs) {
     gs.get().destroy();
   }
+  
+  if (useCache) {
+    _cacheStats.misses++;
+    storeBinary(*cache, key, secondsSince(start));
+  }
+}
+
+bool ShaderProgram::supportsBinaries() {
+  if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+    return false;
+  }
+  
+  // Some drivers expose the entry points but no binary formats at all.
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+const ShaderProgram::CacheStats& ShaderProgram::cacheStats() {
+  return _cacheStats;
+}
+
+bool ShaderProgram::loadBinary(const MappedFile& file) {
+  ProgramCacheHeader header;
+  if (file.size() < sizeof(header)) {
+    return false;
+  }
+  
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.magic, "GLPB", 4) != 0 || header.version != 1 ||
+      file.size() != sizeof(header) + header.binarySize) {
+    return false;
+  }
+  
+  steady_clock::time_point start = steady_clock::now();
+  
+  GLuint programId = glCreateProgram();
+  glProgramBinary(programId, header.binaryFormat, file.data() + sizeof(header),
+    header.binarySize);
+  
+  // The driver may reject a binary at any time, e.g. after an update that kept the
+  // version strings; the link status is the only reliable check.
+  GLint linkedOK = false;
+  glGetProgramiv(programId, GL_LINK_STATUS, &linkedOK);
+  if (!linkedOK) {
+    glDeleteProgram(programId);
+    return false;
+  }
+  
+  _program = programId;
+  reflect();
+  _cacheStats.hits++;
+  _cacheStats.secondsSaved +=
+    std::max(0.0, header.compileSeconds - secondsSince(start));
+  return true;
+}
+
+void ShaderProgram::storeBinary(const FileCache& cache, uint64_t key,
+                                double compileSeconds) {
+  GLint length = 0;
+  glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  
+  vector<unsigned char> binary(length);
+  GLsizei written = 0;
+  GLenum binaryFormat = 0;
+  glGetProgramBinary(_program, length, &written, &binaryFormat, binary.data());
+  if (written <= 0) {
+    return;
+  }
+  
+  ProgramCacheHeader header;
+  memcpy(header.magic, "GLPB", 4);
+  header.version = 1;
+  header.binaryFormat = binaryFormat;
+  header.binarySize = written;
+  header.compileSeconds = compileSeconds;
+  
+  cache.store(key, PROGRAM_CACHE_EXTENSION, &header, sizeof(header),
+    binary.data(), written);
+}
+
+void ShaderProgram::link(GLuint programId) {
+  glLinkProgram(programId);
+  
+  GLint linkedOK = false;
+  glGetProgramiv(programId, GL_LINK_STATUS, &linkedOK);
+  if (!linkedOK) {
+    GLint logSize;
+    glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &logSize);
+    char* logMessage = new char[logSize];
+    glGetProgramInfoLog(programId, logSize, NULL, logMessage);
+    string logString(logMessage);
+    delete[] logMessage;
+    throw GLSLError(logString);
+  }
 }
 
 void ShaderProgram::init(VertexShader vs,
                          FragmentShader fs,
-                         boost::optional<GeometryShader> gs) {
+                         boost::optional<GeometryShader> gs,
+                         bool retrievable) {
   GLuint programId = 0;
   bool shadersAttached = false;
   
@@ -52,19 +246,10 @@ void ShaderProgram::init(VertexShader vs,
     }
     shadersAttached = true;
     
-    glLinkProgram(programId);
-    
-    GLint linkedOK = false;
-    glGetProgramiv(programId, GL_LINK_STATUS, &linkedOK);
-    if (!linkedOK) {
-      GLint logSize;
-      glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &logSize);
-      char* logMessage = new char[logSize];
-      glGetProgramInfoLog(programId, logSize, NULL, logMessage);
-      string logString(logMessage);
-      delete[] logMessage;
-      throw GLSLError(logString);
+    if (retrievable) {
+      glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
+    link(programId);
     
     glDetachShader(programId, vs.shaderId());
     glDetachShader(programId, fs.shaderId());
@@ -73,6 +258,7 @@ void ShaderProgram::init(VertexShader vs,
     }
     
     _program = programId;
+    reflect();
   }
   catch (...) {
     if (programId != 0) glDeleteProgram(programId);
@@ -80,6 +266,70 @@ void ShaderProgram::init(VertexShader vs,
   }
 }
 
+void ShaderProgram::reflect() {
+  GLint count = 0;
+  GLint maxLength = 0;
+  glGetProgramiv(_program, GL_ACTIVE_ATTRIBUTES, &count);
+  glGetProgramiv(_program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+  
+  // Leave room to append an array index to uniform names below.
+  vector<char> name(maxLength + 16);
+  for (GLint i = 0; i < count; i++) {
+    GLint size;
+    GLenum type;
+    glGetActiveAttrib(_program, i, (GLsizei)name.size(), NULL, &size, &type,
+      name.data());
+    
+    // Built-in inputs such as gl_InstanceID are listed but have no location.
+    GLint location = glGetAttribLocation(_program, name.data());
+    if (location != -1) {
+      _attributes.insert(name.data(), location);
+    }
+  }
+  
+  glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  name.resize(maxLength + 16);
+  for (GLint i = 0; i < count; i++) {
+    GLint size;
+    GLenum type;
+    GLsizei length = 0;
+    glGetActiveUniform(_program, i, (GLsizei)name.size(), &length, &size, &type,
+      name.data());
+    
+    // Members of uniform blocks have no location either.
+    GLint location = glGetUniformLocation(_program, name.data());
+    if (location == -1) {
+      continue;
+    }
+    _uniforms.insert(name.data(), location);
+    
+    // Arrays are reported as "name[0]"; also register the bare name and every
+    // element, which may not have consecutive locations.
+    char* bracket = strchr(name.data(), '[');
+    if (bracket) {
+      *bracket = '\0';
+      _uniforms.insert(name.data(), location);
+      for (GLint element = 1; element < size; element++) {
+        snprintf(bracket, name.size() - (bracket - name.data()), "[%d]", element);
+        GLint elementLocation = glGetUniformLocation(_program, name.data());
+        if (elementLocation != -1) {
+          _uniforms.insert(name.data(), elementLocation);
+        }
+      }
+    }
+  }
+  
+  glGetProgramiv(_program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  glGetProgramiv(_program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+  name.resize(maxLength + 1);
+  for (GLint i = 0; i < count; i++) {
+    glGetActiveUniformBlockName(_program, i, (GLsizei)name.size(), NULL,
+      name.data());
+    _uniformBlocks.insert(name.data(), i);
+  }
+}
+
 bool ShaderProgram::valid() const {
   return glIsProgram(_program) == GL_TRUE;
 }
@@ -96,47 +346,42 @@ bool ShaderProgram::use() const {
 void ShaderProgram::destroy() {
   if (valid()) {
     glDeleteProgram(_program);
-    _attributeNames.clear();
-    _uniformNames.clear();
+    _attributes.clear();
+    _uniforms.clear();
+    _uniformBlocks.clear();
   }
 }
 
-GLint ShaderProgram::getAttribute(string attributeName) {
-  try {
-    return _attributeNames.at(attributeName);
-  }
-  catch (out_of_range e) {
-    int a = glGetAttribLocation(_program, attributeName.c_str());
-    if (a == -1) {
-      return -1;
-    }
-    else {
-      _attributeNames[attributeName] = a;
-      return a;
-    }
-  }
+GLint ShaderProgram::getAttribute(const char* attributeName) const {
+  return _attributes.find(attributeName);
 }
 
-GLint ShaderProgram::getUniform(string uniformName) {
-  try {
-    return _uniformNames.at(uniformName);
-  }
-  catch (out_of_range e) {
-    int u = glGetUniformLocation(_program, uniformName.c_str());
-    if (u == -1) {
-      return -1;
-    }
-    else {
-      _uniformNames[uniformName] = u;
-      return u;
-    }
-  }
+GLint ShaderProgram::getUniform(const char* uniformName) const {
+  return _uniforms.find(uniformName);
 }
 
-bool ShaderProgram::hasAttribute(string attributeName) {
+bool ShaderProgram::hasAttribute(const char* attributeName) const {
   return getAttribute(attributeName) != -1;
 }
 
-bool ShaderProgram::hasUniform(string uniformName) {
+bool ShaderProgram::hasUniform(const char* uniformName) const {
   return getUniform(uniformName) != -1;
 }
+
+GLint ShaderProgram::getUniformBlock(const char* blockName) const {
+  return _uniformBlocks.find(blockName);
+}
+
+bool ShaderProgram::hasUniformBlock(const char* blockName) const {
+  return getUniformBlock(blockName) != -1;
+}
+
+bool ShaderProgram::bindUniformBlock(const char* blockName, GLuint binding) const {
+  GLint block = getUniformBlock(blockName);
+  if (block == -1) {
+    return false;
+  }
+  
+  glUniformBlockBinding(_program, block, binding);
+  return true;
+}
@@ -4,19 +4,40 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <string>
-#include <map>
 #include <boost/optional.hpp>
+#include "FileCache.h"
+#include "LocationTable.h"
 #include "Shader.h"
 
 /**
  * A shader program consisting of a vertex shader, a geometry shader, and a fragment shader.
- * The geometry shader is optional.
+ * The geometry shader is optional. Alternatively, a program may consist of a single
+ * compute shader.
  */
 class ShaderProgram {
-  std::map<string, GLint> _attributeNames;
-  std::map<string, GLint> _uniformNames;
+public:
+  /**
+   * Counters for the program binary cache, summed over every program loaded with
+   * a FileCache.
+   */
+  struct CacheStats {
+    int hits;
+    int misses;
+    double secondsSaved;
+  };
+  
+private:
+  LocationTable _attributes;
+  LocationTable _uniforms;
+  LocationTable _uniformBlocks;
   GLuint _program;
-  void init(VertexShader vs, FragmentShader fs, boost::optional<GeometryShader> gs);
+  static CacheStats _cacheStats;
+  void init(VertexShader vs, FragmentShader fs, boost::optional<GeometryShader> gs,
+    bool retrievable = false);
+  void link(GLuint programId);
+  bool loadBinary(const MappedFile& file);
+  void storeBinary(const FileCache& cache, uint64_t key, double compileSeconds);
+  void reflect();
   
 public:
   /**
@@ -29,16 +50,44 @@ public:
    */
   ShaderProgram(VertexShader vs, FragmentShader fs, boost::optional<GeometryShader> gs = boost::optional<GeometryShader>());
   
+  /**
+   * Constructs a compute program from the given compute shader.
+   * @param cs a compute shader
+   * @throws ShaderError if the given shader is invalid
+   * @throws GLSLError if there was a GLSL linking error
+   */
+  explicit ShaderProgram(ComputeShader cs);
+  
   /**
    * Constructs a shader program by loading a vertex and fragment shader from disk.
    * Note: the vertex and fragment shaders will be deleted after the program is compiled.
+   * If a cache is given and the driver supports program binaries, the linked program
+   * is saved to the cache and reloaded from there next time, as long as the shader
+   * sources and the driver stay the same. A binary the driver rejects is recompiled
+   * from source and replaced.
    * @param vs the path to a vertex shader
    * @param fs the path to a fragment shader
    * @param gs (optional) the path to a geometry shader; pass an empty string if none
+   * @param cache (optional) where to keep linked program binaries
    * @throws ifstream::failure if one of the shader text files could not be read
    * @throws GLSLError if there was a GLSL linking error
    */
-  ShaderProgram(const char* vsFileName, const char* fsFileName, const char* gsFileName);
+  ShaderProgram(const char* vsFileName, const char* fsFileName,
+    const char* gsFileName = "", FileCache* cache = NULL);
+  
+  /**
+   * Indicates whether the current OpenGL context can save and load program binaries.
+   * @return whether program binaries are supported
+   */
+  static bool supportsBinaries();
+  
+  /**
+   * Returns the program binary cache counters. A miss is counted whenever a program
+   * had to be compiled from source although a cache was given; the time saved is
+   * the recorded compile time of each hit minus the time it took to load it.
+   * @return the cache counters
+   */
+  static const CacheStats& cacheStats();
   
   /**
    * Indicates whether the program is available for use.
@@ -63,31 +112,60 @@ public:
   
   /**
    * Gets the location of a given shader attribute.
+   * Every active attribute is looked up once when the program is linked, so this
+   * never calls into OpenGL or allocates; it is safe to call every frame.
    * @param the name of the attribute
-   * @return the attribute's integer location
+   * @return the attribute's integer location, or -1 if it is not active
    */
-  GLint getAttribute(string attributeName);
+  GLint getAttribute(const char* attributeName) const;
   
   /**
    * Gets the location of a given shader uniform.
+   * Every active uniform (including each element of an array) is looked up once
+   * when the program is linked, so this never calls into OpenGL or allocates; it
+   * is safe to call every frame.
    * @param the name of the uniform
-   * @return the uniform's integer location
+   * @return the uniform's integer location, or -1 if it is not active
    */
-  GLint getUniform(string uniformName);
+  GLint getUniform(const char* uniformName) const;
   
   /**
    * Determines whether the given attribute can be found in the current program.
    * @param the name of the attribute
    * @return whether the attribute is in the program
    */
-  bool hasAttribute(string attributeName);
+  bool hasAttribute(const char* attributeName) const;
   
   /**
    * Determines whether the given uniform can be found in the current program.
    * @param the name of the uniform
    * @return whether the uniform is in the program
    */
-  bool hasUniform(string uniformName);
+  bool hasUniform(const char* uniformName) const;
+  
+  /**
+   * Gets the index of a given uniform block. Like uniforms, blocks are looked up
+   * once when the program is linked.
+   * @param the name of the uniform block
+   * @return the block's index, or -1 if it is not active
+   */
+  GLint getUniformBlock(const char* blockName) const;
+  
+  /**
+   * Determines whether the given uniform block can be found in the current program.
+   * @param the name of the uniform block
+   * @return whether the uniform block is in the program
+   */
+  bool hasUniformBlock(const char* blockName) const;
+  
+  /**
+   * Assigns a uniform block to a uniform buffer binding point. The assignment is
+   * part of the program state, so it only has to be done once.
+   * @param the name of the uniform block
+   * @param binding the binding point
+   * @return whether the block is in the program
+   */
+  bool bindUniformBlock(const char* blockName, GLuint binding) const;
 };
 
 #endif
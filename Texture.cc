@@ -1,148 +1,97 @@
 #include "Texture.h"
-#include <iostream>
-#include <fstream>
+#include <cmath>
+#include <cstring>
 #include <stdexcept>
-#include "Exceptions.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_SSE2 1
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
-void userReadData(png_structp pngRead, png_bytep data, png_size_t length) {
-  png_voidp f = png_get_io_ptr(pngRead);
-  ((ifstream*)f)->read((char*)data, length);
+Texture::Texture(const char* fileName, Residency residency) {
+  PNGImage image(fileName);
+  init(image, residency, NULL);
+}
+
+Texture::Texture(const PNGImage& image, Residency residency) {
+  init(image, residency, NULL);
+}
+
+Texture::Texture(const PNGImage& image, TextureStreamer& streamer,
+  Residency residency) {
+  if (residency == CPU_ONLY) {
+    throw invalid_argument("A CPU_ONLY texture cannot be streamed");
+  }
+  init(image, residency, &streamer);
 }
 
-Texture::Texture(const char* fileName) {
-  GLuint textureId = 0;
+Texture::Texture(int width, int height, int channels, const png_byte* pixels,
+  const shared_ptr<const void>& owner, TextureStreamer* streamer) {
+  _width = width;
+  _height = height;
+  _streamer = streamer;
+  upload(channels, pixels, owner, streamer);
+}
+
+void Texture::upload(int channels, const png_byte* pixels,
+  const shared_ptr<const void>& owner, TextureStreamer* streamer) {
+  const GLenum format = (channels == 4) ? GL_RGBA : GL_RGB;
+  GLuint textureId;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D, textureId);
+  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   
-  // We need to declare these up here so they can be cleaned up
-  // regardless of error condition.
-  bool pngReadInited = false;
-  bool pngInfoInited = false;
-  png_structp pngRead;
-  png_infop pngInfo;
+  if (streamer) {
+    // Allocate storage now; the streamer fills it and builds the mipmaps.
+    glTexImage2D(GL_TEXTURE_2D, 0, format, _width, _height, 0, format,
+      GL_UNSIGNED_BYTE, NULL);
+    streamer->enqueue(textureId, _width, _height, format, channels, pixels, owner,
+      true);
+  }
+  else {
+    // RGB rows are not 4-byte aligned in general.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, _width, _height, 0, format,
+      GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
   
-  ifstream pngFile;
-  pngFile.exceptions(ifstream::failbit | ifstream::badbit);
+  _texture = textureId;
+}
+
+void Texture::init(const PNGImage& image, Residency residency,
+  TextureStreamer* streamer) {
+  _width = image.width();
+  _height = image.height();
+  _texture = 0;
+  _streamer = streamer;
   
-  try {
-    pngFile.open(fileName, ios::binary);
+  if (residency != CPU_ONLY) {
+    upload(image.channels(), image.pixels()->data(), image.pixels(), streamer);
+  }
   
-    // Check the PNG header (8 bytes).
-    png_byte header[8];
-    pngFile.read((char*)header, 8);
-    if (png_sig_cmp(header, 0, 8)) {
-      throw PNGError("Bad PNG header");
-    }
-
-    // Read the PNG data using libpng.
-    pngRead = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-      NULL, NULL, NULL);
-    if (pngRead) {
-      pngReadInited = true;
+  if (residency != GPU_ONLY) {
+    if (image.channels() == 4) {
+      // Share the decoded pixels as they are.
+      _rgba = image.pixels();
     }
     else {
-      throw PNGError("Could not initialize PNG read");
-    }
-
-    pngInfo = png_create_info_struct(pngRead);
-    if (pngInfo) {
-      pngInfoInited = true;
-    }
-    else {
-      throw PNGError("Could not initialize PNG info");
-    }
-
-    // This error-handling method is prescribed in the libpng manual.
-    if (setjmp(png_jmpbuf(pngRead))) {
-      // An error occurred, so clean up now.
-      throw PNGError("Error occurred while reading PNG");
-    }
-
-    // Have libpng read from our C++ stream.
-    png_set_read_fn(pngRead, (png_voidp)&pngFile, userReadData);
-    
-    // Tell libpng we've already read the 8-byte header.
-    png_set_sig_bytes(pngRead, 8);
-
-    // Read the entire PNG header.
-    png_read_info(pngRead, pngInfo);
-
-    png_uint_32 pngWidth = png_get_image_width(pngRead, pngInfo);
-    png_uint_32 pngHeight = png_get_image_height(pngRead, pngInfo);
-    _width = pngWidth;
-    _height = pngHeight;
-
-    png_uint_32 bitsPerChannel = png_get_bit_depth(pngRead, pngInfo);
-    png_uint_32 channels = png_get_channels(pngRead, pngInfo);
-    png_uint_32 colorType = png_get_color_type(pngRead, pngInfo);
-
-    GLint glFormat;
-    switch (colorType) {
-      case PNG_COLOR_TYPE_PALETTE:
-        png_set_palette_to_rgb(pngRead);
-        channels = 3;
-        glFormat = GL_RGB;
-        break;
-      case PNG_COLOR_TYPE_RGB:
-        glFormat = GL_RGB;
-        break;
-      case PNG_COLOR_TYPE_RGB_ALPHA:
-        glFormat = GL_RGBA;
-        break;
-      default:
-        throw PNGError("Unsupported color type");
-    }
-
-    // Convert any transparency to a full alpha channel.
-    if (png_get_valid(pngRead, pngInfo, PNG_INFO_tRNS)) {
-      png_set_tRNS_to_alpha(pngRead);
-      channels += 1;
-    }
-
-    // Convert 16-bit precision to 8-bit precision.
-    if (bitsPerChannel == 16) png_set_strip_16(pngRead);
-
-    shared_ptr<vector<png_bytep>> rows = make_shared<vector<png_bytep>>(pngHeight);
-    // Note: divide by 8 bits/1 byte.
-    shared_ptr<vector<png_byte>> pngBytes = make_shared<vector<png_byte>>(pngWidth *
-      pngHeight * bitsPerChannel * channels / 8);
-    // Length in bytes of one row.
-    const unsigned int stride = pngWidth * bitsPerChannel * channels / 8;
-
-    for (size_t row = 0; row < pngHeight; row++) {
-      // We're setting the pointers "upside-down".
-      png_uint_32 offset = (pngHeight - row - 1) * stride;
-      (*rows)[row] = (png_bytep)(pngBytes->data()) + offset;
-    }
-
-    // Actually read the image!
-    png_read_image(pngRead, rows->data());
-
-    glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    glTexImage2D(GL_TEXTURE_2D, 0, glFormat, pngWidth, pngHeight, 0,
-      glFormat, GL_UNSIGNED_BYTE, pngBytes->data());
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    if (pngReadInited && pngInfoInited) {
-      png_destroy_read_struct(&pngRead, &pngInfo, (png_infopp)NULL);
-    }
-    
-    _texture = textureId;
-    _rows = rows;
-    _img = pngBytes;
-    _bitsPerChannel = bitsPerChannel;
-    _channels = channels;
-  }
-  catch (...) {
-    // Clean up data.
-    if (textureId != 0) glDeleteTextures(1, &_texture);
-    if (pngReadInited && pngInfoInited) {
-      png_destroy_read_struct(&pngRead, &pngInfo, (png_infopp)NULL);
+      // Expand to RGBA so every texel is a single aligned 4-byte read.
+      const size_t pixelCount = (size_t)_width * _height;
+      const png_byte* rgb = image.pixels()->data();
+      _rgba = make_shared<vector<png_byte>>(pixelCount * 4);
+      png_byte* rgba = _rgba->data();
+      for (size_t i = 0; i < pixelCount; i++) {
+        rgba[i * 4] = rgb[i * 3];
+        rgba[i * 4 + 1] = rgb[i * 3 + 1];
+        rgba[i * 4 + 2] = rgb[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+      }
     }
-    throw;
   }
 }
 
@@ -160,6 +109,9 @@ bool Texture::valid() const {
 
 void Texture::destroy() {
   if (valid()) {
+    if (_streamer) {
+      _streamer->cancel(_texture);
+    }
     glDeleteTextures(1, &_texture);
   }
 }
@@ -168,27 +120,279 @@ void Texture::bind() const {
   glBindTexture(GL_TEXTURE_2D, _texture);
 }
 
+bool Texture::ready() const {
+  return !_streamer || _streamer->ready(_texture);
+}
+
+bool Texture::hasPixels() const {
+  return (bool)_rgba;
+}
+
+void Texture::releasePixels() {
+  _rgba.reset();
+}
+
+bool Texture::texel(int col, int row, RGBColor& out) const {
+  if (!_rgba || col < 0 || col >= _width || row < 0 || row >= _height) {
+    return false;
+  }
+  
+  // Rows are stored bottom row first, but row 0 is the top of the PNG.
+  const png_byte* px = _rgba->data() +
+    ((size_t)(_height - row - 1) * _width + col) * 4;
+  out = RGBColor(px[0], px[1], px[2], px[3]);
+  return true;
+}
+
+namespace {
+  /**
+   * Wraps a texture coordinate to [0, 1] like GL_REPEAT. Infinities and NaNs have
+   * no position within the texture and become 0, rather than indices far outside
+   * it.
+   */
+  inline float wrapCoordinate(float u) {
+    u = u - floorf(u);
+    return (u == u) ? u : 0.0f;
+  }
+  
+  /**
+   * The texels and weights needed to filter one sample. Weights are 8-bit fixed
+   * point, from 0 to 255.
+   */
+  struct Footprint {
+    int x0, x1, y0, y1;
+    int fx, fy;
+  };
+  
+  /**
+   * Finds the bilinear footprint of a texture coordinate, wrapping like GL_REPEAT.
+   */
+  inline Footprint bilinearFootprint(float u, float v, int width, int height) {
+    u = wrapCoordinate(u);
+    v = wrapCoordinate(v);
+    float x = u * (float)width - 0.5f;
+    float y = v * (float)height - 0.5f;
+    float xf = floorf(x);
+    float yf = floorf(y);
+    int xi = (int)xf;
+    int yi = (int)yf;
+    
+    Footprint f;
+    f.x0 = (xi < 0) ? xi + width : xi;
+    f.x1 = (xi + 1 == width) ? 0 : xi + 1;
+    f.y0 = (yi < 0) ? yi + height : yi;
+    f.y1 = (yi + 1 == height) ? 0 : yi + 1;
+    f.fx = (int)((x - xf) * 256.0f);
+    f.fy = (int)((y - yf) * 256.0f);
+    return f;
+  }
+  
+  inline int nearestTexel(float u, int size) {
+    u = wrapCoordinate(u);
+    int i = (int)(u * (float)size);
+    return (i >= size) ? size - 1 : i;
+  }
+  
+  inline uint32_t loadTexel(const png_byte* pixels, size_t index) {
+    uint32_t texel;
+    memcpy(&texel, pixels + index * 4, 4);
+    return texel;
+  }
+  
+  inline void storeColor(RGBColor* out, uint32_t color) {
+    memcpy((void*)out, &color, 4);
+  }
+  
+  /**
+   * Blends four RGBA8 texels. Rows are blended first and truncated to 8 bits, then
+   * blended vertically with rounding; the SSE2 version does exactly the same.
+   */
+  inline uint32_t blendScalar(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11,
+    int fx, int fy) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      int top = (((t00 >> shift) & 0xFF) * (256 - fx) +
+                 ((t10 >> shift) & 0xFF) * fx) >> 8;
+      int bottom = (((t01 >> shift) & 0xFF) * (256 - fx) +
+                    ((t11 >> shift) & 0xFF) * fx) >> 8;
+      int value = (top * (256 - fy) + bottom * fy + 128) >> 8;
+      result |= (uint32_t)value << shift;
+    }
+    return result;
+  }
+  
+#ifdef TEXTURE_SSE2
+  /**
+   * SSE2 floor. Floats of magnitude 2^23 and above are whole already and may not
+   * fit in a 32-bit integer, so they are returned as they are, as are infinities
+   * and NaNs.
+   */
+  inline __m128 floorSSE2(__m128 x) {
+    const __m128 magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    const __m128 fractional = _mm_cmplt_ps(magnitude, _mm_set1_ps(8388608.0f));
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    __m128 tooBig = _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f));
+    __m128 floored = _mm_sub_ps(truncated, tooBig);
+    return _mm_or_ps(_mm_and_ps(fractional, floored), _mm_andnot_ps(fractional, x));
+  }
+  
+  /**
+   * Blends four RGBA8 texels with 16-bit lanes: each step multiplies a pair of
+   * texels by their weights in one instruction and folds the halves together.
+   */
+  inline uint32_t blendSSE2(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11,
+    int fx, int fy) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+      _mm_cvtsi32_si128((int)t00), _mm_cvtsi32_si128((int)t10)), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+      _mm_cvtsi32_si128((int)t01), _mm_cvtsi32_si128((int)t11)), zero);
+    
+    const short wx0 = (short)(256 - fx);
+    const short wx1 = (short)fx;
+    __m128i wx = _mm_set_epi16(wx1, wx1, wx1, wx1, wx0, wx0, wx0, wx0);
+    top = _mm_mullo_epi16(top, wx);
+    top = _mm_srli_epi16(_mm_add_epi16(top, _mm_srli_si128(top, 8)), 8);
+    bottom = _mm_mullo_epi16(bottom, wx);
+    bottom = _mm_srli_epi16(_mm_add_epi16(bottom, _mm_srli_si128(bottom, 8)), 8);
+    
+    const short wy0 = (short)(256 - fy);
+    const short wy1 = (short)fy;
+    __m128i wy = _mm_set_epi16(wy1, wy1, wy1, wy1, wy0, wy0, wy0, wy0);
+    __m128i rows = _mm_mullo_epi16(_mm_unpacklo_epi64(top, bottom), wy);
+    rows = _mm_add_epi16(rows, _mm_srli_si128(rows, 8));
+    rows = _mm_srli_epi16(_mm_add_epi16(rows, _mm_set1_epi16(128)), 8);
+    
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(rows, rows));
+  }
+  
+  /**
+   * Splits four interleaved texture coordinates into u and v, wrapped to [0, 1]
+   * as wrapCoordinate() does.
+   */
+  inline void loadWrapped(const glm::vec2* uvs, __m128& u, __m128& v) {
+    __m128 a = _mm_loadu_ps(&uvs[0].x);
+    __m128 b = _mm_loadu_ps(&uvs[2].x);
+    u = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    v = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    u = _mm_sub_ps(u, floorSSE2(u));
+    v = _mm_sub_ps(v, floorSSE2(v));
+    u = _mm_and_ps(u, _mm_cmpord_ps(u, u));
+    v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+  }
+  
+  /**
+   * Wraps integer texel coordinates in [-1, size - 1] to [0, size), and returns
+   * the wrapped coordinate of the next texel.
+   */
+  inline void wrapPair(__m128i i, __m128i size, __m128i& i0, __m128i& i1) {
+    i0 = _mm_add_epi32(i, _mm_and_si128(_mm_cmplt_epi32(i, _mm_setzero_si128()), size));
+    i1 = _mm_add_epi32(i, _mm_set1_epi32(1));
+    i1 = _mm_andnot_si128(_mm_cmpeq_epi32(i1, size), i1);
+  }
+#endif
+}
 
-void Texture::get(int col, int row, unsigned char& outR, unsigned char& outG,
-  unsigned char& outB, unsigned char& outA) const {
-  if (row > _height || row < 0)
-    throw PNGError("row out of bounds");
-  if (col > _width || col < 0)
-    throw PNGError("col out of bounds");
+bool Texture::sample(const glm::vec2* uvs, size_t count, RGBColor* out,
+  Filter filter) const {
+  if (!_rgba) {
+    return false;
+  }
   
-  const int bytesPerPixel = _bitsPerChannel * _channels / 8;
-  if (bytesPerPixel < 3) // PNG must have at least RGB bytes.
-    throw PNGError("PNG cannot be sampled");
+  const png_byte* pixels = _rgba->data();
+  const size_t width = _width;
+  size_t i = 0;
   
-  png_bytep rowPtr = (*_rows)[row];
-  png_bytep pxPtr = rowPtr + bytesPerPixel * col;
-  outR = *(pxPtr);
-  outG = *(pxPtr + 1);
-  outB = *(pxPtr + 2);
-  if (bytesPerPixel > 3) {
-    outA = *(pxPtr + 3); // Use Alpha byte if PNG has it.
+#ifdef TEXTURE_SSE2
+  const __m128 widthF = _mm_set1_ps((float)_width);
+  const __m128 heightF = _mm_set1_ps((float)_height);
+  const __m128i widthI = _mm_set1_epi32(_width);
+  const __m128i heightI = _mm_set1_epi32(_height);
+  
+  if (filter == BILINEAR) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 fixedOne = _mm_set1_ps(256.0f);
+    
+    for (; i + 4 <= count; i += 4) {
+      __m128 u, v;
+      loadWrapped(uvs + i, u, v);
+      
+      __m128 x = _mm_sub_ps(_mm_mul_ps(u, widthF), half);
+      __m128 y = _mm_sub_ps(_mm_mul_ps(v, heightF), half);
+      __m128 xf = floorSSE2(x);
+      __m128 yf = floorSSE2(y);
+      
+      __m128i x0, x1, y0, y1;
+      wrapPair(_mm_cvttps_epi32(xf), widthI, x0, x1);
+      wrapPair(_mm_cvttps_epi32(yf), heightI, y0, y1);
+      __m128i fx = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(x, xf), fixedOne));
+      __m128i fy = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(y, yf), fixedOne));
+      
+      int lanes[6][4];
+      _mm_storeu_si128((__m128i*)lanes[0], x0);
+      _mm_storeu_si128((__m128i*)lanes[1], x1);
+      _mm_storeu_si128((__m128i*)lanes[2], y0);
+      _mm_storeu_si128((__m128i*)lanes[3], y1);
+      _mm_storeu_si128((__m128i*)lanes[4], fx);
+      _mm_storeu_si128((__m128i*)lanes[5], fy);
+      
+      for (int lane = 0; lane < 4; lane++) {
+        size_t row0 = lanes[2][lane] * width;
+        size_t row1 = lanes[3][lane] * width;
+        uint32_t color = blendSSE2(
+          loadTexel(pixels, row0 + lanes[0][lane]),
+          loadTexel(pixels, row0 + lanes[1][lane]),
+          loadTexel(pixels, row1 + lanes[0][lane]),
+          loadTexel(pixels, row1 + lanes[1][lane]),
+          lanes[4][lane], lanes[5][lane]);
+        storeColor(out + i + lane, color);
+      }
+    }
   }
   else {
-    outA = 255; // If PNG has RGB but no Alpha, set Alpha to 255 (max).
+    const __m128i lastColumn = _mm_set1_epi32(_width - 1);
+    const __m128i lastRow = _mm_set1_epi32(_height - 1);
+    
+    for (; i + 4 <= count; i += 4) {
+      __m128 u, v;
+      loadWrapped(uvs + i, u, v);
+      
+      __m128i x = _mm_cvttps_epi32(_mm_mul_ps(u, widthF));
+      __m128i y = _mm_cvttps_epi32(_mm_mul_ps(v, heightF));
+      __m128i xOver = _mm_cmpgt_epi32(x, lastColumn);
+      __m128i yOver = _mm_cmpgt_epi32(y, lastRow);
+      x = _mm_or_si128(_mm_andnot_si128(xOver, x), _mm_and_si128(xOver, lastColumn));
+      y = _mm_or_si128(_mm_andnot_si128(yOver, y), _mm_and_si128(yOver, lastRow));
+      
+      int lanes[2][4];
+      _mm_storeu_si128((__m128i*)lanes[0], x);
+      _mm_storeu_si128((__m128i*)lanes[1], y);
+      for (int lane = 0; lane < 4; lane++) {
+        uint32_t color = loadTexel(pixels, lanes[1][lane] * width + lanes[0][lane]);
+        storeColor(out + i + lane, color);
+      }
+    }
   }
+#endif
+  
+  // Scalar path for the remainder, or everything without SSE2.
+  for (; i < count; i++) {
+    uint32_t color;
+    if (filter == BILINEAR) {
+      Footprint f = bilinearFootprint(uvs[i].x, uvs[i].y, _width, _height);
+      color = blendScalar(
+        loadTexel(pixels, f.y0 * width + f.x0),
+        loadTexel(pixels, f.y0 * width + f.x1),
+        loadTexel(pixels, f.y1 * width + f.x0),
+        loadTexel(pixels, f.y1 * width + f.x1),
+        f.fx, f.fy);
+    }
+    else {
+      color = loadTexel(pixels, nearestTexel(uvs[i].y, _height) * width +
+        nearestTexel(uvs[i].x, _width));
+    }
+    storeColor(out + i, color);
+  }
+  
+  return true;
 }
@@ -6,19 +6,49 @@
 #include <png.h>
 #include <memory>
 #include <vector>
+#include <glm/glm.hpp>
+#include "PNGImage.h"
+#include "RGBColor.h"
+#include "TextureStreamer.h"
 
 /**
  * A texture loaded from a PNG.
- * Upon construction, an OpenGL texture will automatically be created.
+ * Upon construction, an OpenGL texture will automatically be created, unless the
+ * texture is CPU_ONLY.
  */
 class Texture {
+ public:
+  /**
+   * Where the texture's pixels are kept after loading.
+   * GPU_ONLY uploads the pixels and then frees the CPU copy.
+   * CPU_ONLY keeps the pixels for texel() and sample() and never creates an OpenGL
+   * texture.
+   * GPU_AND_CPU does both.
+   */
+  enum Residency {
+    GPU_ONLY,
+    CPU_ONLY,
+    GPU_AND_CPU
+  };
+  
+  /**
+   * How sample() filters between texels.
+   */
+  enum Filter {
+    NEAREST,
+    BILINEAR
+  };
+
+ private:
   int _width;
   int _height;
   GLuint _texture;
-  std::shared_ptr<std::vector<png_bytep>> _rows;
-  std::shared_ptr<std::vector<png_byte>> _img;
-  png_uint_32 _bitsPerChannel;
-  png_uint_32 _channels;
+  TextureStreamer* _streamer;
+  // CPU copy as RGBA8, bottom row first; empty unless requested.
+  std::shared_ptr<std::vector<png_byte>> _rgba;
+  void init(const PNGImage& image, Residency residency, TextureStreamer* streamer);
+  void upload(int channels, const png_byte* pixels,
+    const std::shared_ptr<const void>& owner, TextureStreamer* streamer);
 
  public:
   /**
@@ -31,10 +61,52 @@ class Texture {
    * is an integer, before calling this constructor.
    * 
    * @param fileName the path to the PNG file
-   * @throws ifstream::failure if the file could not be read
+   * @param residency where to keep the pixels (see Residency)
+   * @throws IOError if the file could not be read
    * @throws PNGError if the PNG data was invalid or corrupt
    */
-  Texture(const char* fileName);
+  Texture(const char* fileName, Residency residency = GPU_ONLY);
+  
+  /**
+   * Constructs a Texture from an already decoded PNG, e.g. one decoded on a
+   * worker thread. This must be called on the thread that owns the OpenGL context.
+   * As with the file constructor, the texture will be bound during its construction.
+   * 
+   * @param image the decoded PNG
+   * @param residency where to keep the pixels (see Residency)
+   */
+  explicit Texture(const PNGImage& image, Residency residency = GPU_ONLY);
+  
+  /**
+   * Constructs a Texture from an already decoded PNG and streams its pixels in
+   * over the next frames. The texture has storage right away, but its contents
+   * (and mipmaps) are undefined until ready() returns true.
+   * 
+   * @param image the decoded PNG
+   * @param streamer the streamer to upload through; must outlive the texture
+   * @param residency where to keep the pixels (see Residency); GPU_ONLY or
+   *                  GPU_AND_CPU, since a CPU_ONLY texture has nothing to stream
+   * @throws invalid_argument if residency is CPU_ONLY
+   */
+  Texture(const PNGImage& image, TextureStreamer& streamer,
+    Residency residency = GPU_ONLY);
+  
+  /**
+   * Constructs a Texture from pixels decoded earlier, e.g. loaded from a FurAsset,
+   * without keeping a CPU copy. As with the other constructors, the texture will
+   * be bound during its construction.
+   * 
+   * @param width the width of the image, in pixels
+   * @param height the height of the image, in pixels
+   * @param channels the number of 8-bit channels per pixel (3 or 4)
+   * @param pixels the pixels, bottom row first, as PNGImage holds them
+   * @param owner (optional) keeps the pixels alive until a streamed upload is done
+   * @param streamer (optional) streams the pixels in over the next frames instead
+   *                 of uploading them right away; see ready()
+   */
+  Texture(int width, int height, int channels, const png_byte* pixels,
+    const std::shared_ptr<const void>& owner = std::shared_ptr<const void>(),
+    TextureStreamer* streamer = NULL);
   
   /**
    * Returns the width of the texture, in pixels, or 0 if the texture could not be loaded.
@@ -59,7 +131,8 @@ class Texture {
   bool valid() const;
   
   /**
-   * Tells OpenGL to mark the texture for deletion.
+   * Tells OpenGL to mark the texture for deletion. A streamed texture's pending
+   * upload is cancelled first.
    */
   void destroy();
   
@@ -69,19 +142,46 @@ class Texture {
   void bind() const;
   
   /**
-   * Gets the color of the texture at the given coordinates. Each component is given
-   * as a char, where 0=minimum and 255=maximum, e.g. alpha=0 is transparent and
-   * alpha=255 is opaque.
-   * @param col the x-coordinates
-   * @param row the y-coordinates
-   * @param outR where the output red value will be placed
-   * @param outG where the output green value will be placed
-   * @param outB where the output blue value will be placed
-   * @param outA where the output alpha value will be placed (may just be 255 if the
-   *             image has no alpha channel)
-   */
-  void get(int col, int row, unsigned char& outR, unsigned char& outG,
-    unsigned char& outB, unsigned char& outA) const;
+   * Indicates whether the texture has finished uploading. Always true unless the
+   * texture was created with a TextureStreamer.
+   * @return whether the texture contents are resident
+   */
+  bool ready() const;
+  
+  /**
+   * Indicates whether the texture kept a CPU copy of its pixels.
+   * @return whether texel() and sample() can be used
+   */
+  bool hasPixels() const;
+  
+  /**
+   * Frees the CPU copy of the pixels, if any. The OpenGL texture is unaffected.
+   */
+  void releasePixels();
+  
+  /**
+   * Reads one pixel from the CPU copy. Images without an alpha channel read as
+   * opaque. Never throws.
+   * @param col the x-coordinate, from 0 (left) to width() - 1
+   * @param row the y-coordinate, from 0 (top) to height() - 1
+   * @param out where the pixel will be placed
+   * @return false if the coordinates are out of bounds or there is no CPU copy
+   */
+  bool texel(int col, int row, RGBColor& out) const;
+  
+  /**
+   * Samples the CPU copy at many texture coordinates at once. Coordinates follow
+   * OpenGL: (0, 0) is the bottom-left corner, texel centers are at half-texel
+   * offsets, and coordinates outside [0, 1] wrap as with GL_REPEAT. Uses SSE2 on
+   * x86 and an equivalent scalar path elsewhere; both give identical results.
+   * @param uvs the texture coordinates
+   * @param count the number of coordinates
+   * @param out where count colors will be placed
+   * @param filter how to filter between texels
+   * @return false if there is no CPU copy
+   */
+  bool sample(const glm::vec2* uvs, size_t count, RGBColor* out,
+    Filter filter) const;
  };
 
  #endif
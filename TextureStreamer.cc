@@ -0,0 +1,119 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+TextureStreamer::TextureStreamer(size_t bytesPerFrame) :
+  _bytesPerFrame(bytesPerFrame) {
+  glGenBuffers(1, &_buffer);
+}
+
+TextureStreamer::~TextureStreamer() {
+  for (auto& fence : _fences) {
+    glDeleteSync(fence.second);
+  }
+  glDeleteBuffers(1, &_buffer);
+}
+
+void TextureStreamer::forgetFence(GLuint texture) {
+  map<GLuint, GLsync>::iterator fence = _fences.find(texture);
+  if (fence != _fences.end()) {
+    glDeleteSync(fence->second);
+    _fences.erase(fence);
+  }
+}
+
+void TextureStreamer::enqueue(GLuint texture, int width, int height,
+  GLenum format, int bytesPerPixel, const unsigned char* pixels,
+  shared_ptr<const void> owner, bool generateMipmaps) {
+  Upload upload;
+  upload.texture = texture;
+  upload.width = width;
+  upload.height = height;
+  upload.format = format;
+  upload.rowBytes = (size_t)width * bytesPerPixel;
+  upload.pixels = pixels;
+  upload.owner = owner;
+  upload.generateMipmaps = generateMipmaps;
+  upload.nextRow = 0;
+  _queue.push_back(upload);
+  
+  // Forget any earlier upload into the same texture.
+  forgetFence(texture);
+}
+
+void TextureStreamer::update() {
+  if (_queue.empty()) {
+    return;
+  }
+  
+  Upload& upload = _queue.front();
+  int rows = (int)max((size_t)1, _bytesPerFrame / upload.rowBytes);
+  rows = min(rows, upload.height - upload.nextRow);
+  const size_t bytes = rows * upload.rowBytes;
+  
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glBindTexture(GL_TEXTURE_2D, upload.texture);
+  
+  // Orphan the buffer so we never wait on the previous frame's upload.
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+  void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (staging) {
+    memcpy(staging, upload.pixels + upload.nextRow * upload.rowBytes, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.nextRow, upload.width, rows,
+      upload.format, GL_UNSIGNED_BYTE, (void*)0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    upload.nextRow += rows;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  
+  if (upload.nextRow == upload.height) {
+    if (upload.generateMipmaps) {
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    _fences[upload.texture] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _queue.pop_front();
+  }
+  
+  glBindTexture(GL_TEXTURE_2D, previousTexture);
+}
+
+bool TextureStreamer::ready(GLuint texture) {
+  for (const Upload& upload : _queue) {
+    if (upload.texture == texture) {
+      return false;
+    }
+  }
+  
+  map<GLuint, GLsync>::iterator fence = _fences.find(texture);
+  if (fence == _fences.end()) {
+    return true;
+  }
+  
+  GLenum status = glClientWaitSync(fence->second, 0, 0);
+  if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+    glDeleteSync(fence->second);
+    _fences.erase(fence);
+    return true;
+  }
+  
+  return false;
+}
+
+void TextureStreamer::cancel(GLuint texture) {
+  _queue.erase(remove_if(_queue.begin(), _queue.end(),
+    [texture](const Upload& upload) { return upload.texture == texture; }),
+    _queue.end());
+  forgetFence(texture);
+}
+
+bool TextureStreamer::idle() const {
+  return _queue.empty();
+}
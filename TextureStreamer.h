@@ -0,0 +1,101 @@
+#ifndef _TEXTURESTREAMER_H_
+#define _TEXTURESTREAMER_H_
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+
+/**
+ * Uploads texture pixels a few rows per frame through a pixel buffer object, so
+ * that large textures become resident over several frames instead of stalling one.
+ *
+ * The buffer is orphaned before every upload, so the driver hands out fresh
+ * storage instead of waiting for the previous upload to finish. After the last
+ * rows of a texture (and its mipmaps, if requested) are submitted, a fence is
+ * inserted; the texture is ready once the GPU has passed it.
+ */
+class TextureStreamer {
+  struct Upload {
+    GLuint texture;
+    int width;
+    int height;
+    GLenum format;
+    size_t rowBytes;
+    const unsigned char* pixels;
+    std::shared_ptr<const void> owner;
+    bool generateMipmaps;
+    int nextRow;
+  };
+
+  GLuint _buffer;
+  size_t _bytesPerFrame;
+  std::deque<Upload> _queue;
+  std::map<GLuint, GLsync> _fences;
+
+  void forgetFence(GLuint texture);
+
+  TextureStreamer(const TextureStreamer&);
+  TextureStreamer& operator=(const TextureStreamer&);
+
+public:
+  /**
+   * Creates the pixel buffer object used for staging.
+   * @param bytesPerFrame roughly how many bytes to upload per update(); at least
+   *                      one row of the current texture is always uploaded
+   */
+  explicit TextureStreamer(size_t bytesPerFrame = 4 << 20);
+
+  /**
+   * Deletes the staging buffer and any pending fences.
+   */
+  ~TextureStreamer();
+
+  /**
+   * Queues pixels for upload into level 0 of a texture. The texture must already
+   * have storage of the given size (e.g. from glTexImage2D with NULL data).
+   * @param texture the OpenGL texture to upload into
+   * @param width the width of the texture, in pixels
+   * @param height the height of the texture, in pixels
+   * @param format the pixel format of the data (e.g. GL_RGBA), 8 bits per channel
+   * @param bytesPerPixel the number of bytes per pixel
+   * @param pixels tightly packed rows, bottom row first
+   * @param owner keeps the pixels alive until they have been uploaded
+   * @param generateMipmaps whether to generate mipmaps after the last row
+   */
+  void enqueue(GLuint texture, int width, int height, GLenum format,
+    int bytesPerPixel, const unsigned char* pixels,
+    std::shared_ptr<const void> owner, bool generateMipmaps);
+
+  /**
+   * Uploads the next rows. Call once per frame on the thread that owns the
+   * OpenGL context. Does nothing once the queue is empty.
+   */
+  void update();
+
+  /**
+   * Indicates whether a texture has been completely uploaded and the GPU has
+   * finished with the upload. Never blocks.
+   * @param texture the OpenGL texture
+   * @return true if the texture is resident, or was never queued
+   */
+  bool ready(GLuint texture);
+
+  /**
+   * Drops a texture's queued upload and forgets its fence. Call before deleting
+   * a texture that may still be queued, or its name could be uploaded into after
+   * OpenGL has handed it out again.
+   * @param texture the OpenGL texture
+   */
+  void cancel(GLuint texture);
+
+  /**
+   * Indicates whether every queued upload has been submitted.
+   * @return whether the queue is empty
+   */
+  bool idle() const;
+};
+
+#endif
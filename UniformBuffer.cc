@@ -0,0 +1,100 @@
+#include "UniformBuffer.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+UniformRing::UniformRing(size_t bytesPerFrame, int framesInFlight) :
+  _mapped(NULL), _segments(framesInFlight), _segment(0), _offset(0),
+  _fences(framesInFlight, (GLsync)0) {
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  _alignment = (size_t)max(alignment, 1);
+
+  // Every segment starts on an aligned offset.
+  _segmentSize = (bytesPerFrame + _alignment - 1) / _alignment * _alignment;
+  const size_t size = _segmentSize * _segments;
+
+  glGenBuffers(1, &_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+  if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+    const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+    _mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+  }
+  else {
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRing::~UniformRing() {
+  for (GLsync fence : _fences) {
+    if (fence) glDeleteSync(fence);
+  }
+
+  if (_mapped) {
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &_buffer);
+}
+
+bool UniformRing::persistent() const {
+  return _mapped != NULL;
+}
+
+void UniformRing::beginFrame() {
+  _segment = (_segment + 1) % _segments;
+  _offset = 0;
+
+  // With enough segments the fence has long been passed, and this returns at once.
+  GLsync& fence = _fences[_segment];
+  if (fence) {
+    GLbitfield flags = 0;
+    while (true) {
+      GLenum status = glClientWaitSync(fence, flags, 1000000000ull);
+      if (status != GL_TIMEOUT_EXPIRED) break;
+      flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    }
+    glDeleteSync(fence);
+    fence = 0;
+  }
+}
+
+GLintptr UniformRing::write(const void* data, size_t size) {
+  if (_offset + size > _segmentSize) {
+    throw overflow_error("Uniform ring segment is full");
+  }
+
+  const GLintptr offset = (GLintptr)(_segment * _segmentSize + _offset);
+  if (_mapped) {
+    memcpy(_mapped + offset, data, size);
+  }
+  else {
+    // The fence in beginFrame() already guarantees the range is not in use.
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    void* target = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (target) {
+      memcpy(target, data, size);
+      glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  _offset += (size + _alignment - 1) / _alignment * _alignment;
+  return offset;
+}
+
+void UniformRing::bindRange(GLuint index, GLintptr offset, size_t size) const {
+  glBindBufferRange(GL_UNIFORM_BUFFER, index, _buffer, offset, size);
+}
+
+void UniformRing::endFrame() {
+  GLsync& fence = _fences[_segment];
+  if (fence) glDeleteSync(fence);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
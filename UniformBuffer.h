@@ -0,0 +1,157 @@
+#ifndef _UNIFORMBUFFER_H_
+#define _UNIFORMBUFFER_H_
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+/**
+ * A uniform buffer holding one std140 block that changes rarely, such as the
+ * per-frame camera state. The block is kept on the CPU and only uploaded when it
+ * actually changed since the last upload.
+ * T must be a plain struct laid out the way the block is in std140.
+ */
+template <typename T>
+class UniformBlock {
+  GLuint _buffer;
+  T _data;
+  bool _dirty;
+
+  UniformBlock(const UniformBlock&);
+  UniformBlock& operator=(const UniformBlock&);
+
+public:
+  /**
+   * Creates the buffer; the block starts out value-initialized.
+   */
+  UniformBlock() : _data(), _dirty(true) {
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  /**
+   * Deletes the buffer.
+   */
+  ~UniformBlock() {
+    glDeleteBuffers(1, &_buffer);
+  }
+
+  /**
+   * Returns the CPU copy of the block.
+   * @return the block contents
+   */
+  const T& get() const {
+    return _data;
+  }
+
+  /**
+   * Replaces the block. Nothing is marked dirty if the contents are the same.
+   * @param data the new block contents
+   */
+  void set(const T& data) {
+    if (memcmp(&_data, &data, sizeof(T)) != 0) {
+      _data = data;
+      _dirty = true;
+    }
+  }
+
+  /**
+   * Indicates whether the next bind() will upload the block.
+   * @return whether the block changed since the last upload
+   */
+  bool dirty() const {
+    return _dirty;
+  }
+
+  /**
+   * Uploads the block if it changed and binds it to a uniform buffer binding point.
+   * @param index the binding point
+   */
+  void bind(GLuint index) {
+    if (_dirty) {
+      glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &_data);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      _dirty = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, index, _buffer);
+  }
+};
+
+/**
+ * A uniform buffer used as a ring of per-frame segments, for blocks that change
+ * on every draw, such as per-object transforms. Each draw copies its block into
+ * the current segment and binds just that range, so the per-draw uniform traffic
+ * is one memcpy and one glBindBufferRange call.
+ *
+ * On GL 4.4 (or with ARB_buffer_storage) the buffer is mapped once, persistently
+ * and coherently; otherwise each write maps its range unsynchronized. Either way a
+ * fence guards every segment, so a segment is only reused once the GPU has read it.
+ */
+class UniformRing {
+  GLuint _buffer;
+  unsigned char* _mapped;
+  size_t _segmentSize;
+  int _segments;
+  int _segment;
+  size_t _offset;
+  size_t _alignment;
+  std::vector<GLsync> _fences;
+
+  UniformRing(const UniformRing&);
+  UniformRing& operator=(const UniformRing&);
+
+public:
+  /**
+   * Creates and, if possible, persistently maps the ring buffer.
+   * @param bytesPerFrame the space available for blocks written in one frame
+   * @param framesInFlight the number of frames the GPU may lag behind
+   */
+  explicit UniformRing(size_t bytesPerFrame = 256 << 10, int framesInFlight = 3);
+
+  /**
+   * Unmaps and deletes the buffer and any pending fences.
+   */
+  ~UniformRing();
+
+  /**
+   * Indicates whether the buffer is persistently mapped.
+   * @return whether the buffer is persistently mapped
+   */
+  bool persistent() const;
+
+  /**
+   * Moves on to the next segment, waiting for the GPU to finish reading it if it
+   * is still in use. Call once per frame before the first write().
+   */
+  void beginFrame();
+
+  /**
+   * Copies a block into the current segment.
+   * @param data the block, laid out as std140
+   * @param size the size of the block, in bytes
+   * @return the offset of the copy within the buffer
+   * @throws overflow_error if the segment has no room left this frame
+   */
+  GLintptr write(const void* data, size_t size);
+
+  /**
+   * Binds a block previously returned by write() to a binding point.
+   * @param index the binding point
+   * @param offset the offset returned by write()
+   * @param size the size of the block, in bytes
+   */
+  void bindRange(GLuint index, GLintptr offset, size_t size) const;
+
+  /**
+   * Fences the current segment. Call once per frame after the last draw that
+   * reads from it.
+   */
+  void endFrame();
+};
+
+#endif
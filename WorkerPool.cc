@@ -0,0 +1,130 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+using namespace std;
+
+WorkerPool::WorkerPool(int threads) :
+  _job(NULL), _count(0), _grain(1), _next(0), _active(0), _generation(0),
+  _stopping(false) {
+  if (threads <= 0) {
+    threads = max(1, (int)thread::hardware_concurrency());
+  }
+
+  for (int i = 1; i < threads; i++) {
+    _workers.push_back(thread(&WorkerPool::workerLoop, this));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_all();
+
+  for (thread& worker : _workers) {
+    worker.join();
+  }
+}
+
+int WorkerPool::threads() const {
+  return (int)_workers.size() + 1;
+}
+
+void WorkerPool::workerLoop() {
+  unsigned long long seenGeneration = 0;
+
+  for (;;) {
+    {
+      unique_lock<mutex> lock(_mutex);
+      _wake.wait(lock, [&] {
+        return _stopping || _generation != seenGeneration;
+      });
+      if (_stopping) {
+        return;
+      }
+
+      seenGeneration = _generation;
+      if (_job == NULL) {
+        // Woke up after the caller already finished the loop by itself.
+        continue;
+      }
+      _active++;
+    }
+
+    runChunks();
+
+    {
+      lock_guard<mutex> lock(_mutex);
+      if (--_active == 0) {
+        _done.notify_all();
+      }
+    }
+  }
+}
+
+void WorkerPool::runChunks() {
+  for (;;) {
+    int begin = _next.fetch_add(_grain);
+    if (begin >= _count) {
+      return;
+    }
+
+    int end = min(begin + _grain, _count);
+    try {
+      (*_job)(begin, end);
+    }
+    catch (...) {
+      lock_guard<mutex> lock(_mutex);
+      if (!_error) {
+        _error = current_exception();
+      }
+    }
+  }
+}
+
+void WorkerPool::parallelFor(int count, int grain,
+  const function<void(int, int)>& fn) {
+  if (count <= 0) {
+    return;
+  }
+
+  grain = max(grain, 1);
+  if (_workers.empty() || count <= grain) {
+    fn(0, count);
+    return;
+  }
+
+  lock_guard<mutex> callLock(_callMutex);
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    _job = &fn;
+    _count = count;
+    _grain = grain;
+    _next = 0;
+    _error = exception_ptr();
+    _generation++;
+  }
+  _wake.notify_all();
+
+  runChunks();
+
+  exception_ptr error;
+  {
+    unique_lock<mutex> lock(_mutex);
+    _done.wait(lock, [&] { return _active == 0; });
+    _job = NULL;
+    error = _error;
+    _error = exception_ptr();
+  }
+
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+WorkerPool& WorkerPool::shared() {
+  static WorkerPool pool;
+  return pool;
+}
@@ -0,0 +1,77 @@
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads for data-parallel loops.
+ * The thread calling parallelFor() also works on the loop, so a pool of n threads
+ * starts n - 1 workers.
+ */
+class WorkerPool {
+  std::vector<std::thread> _workers;
+  std::mutex _callMutex;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+  const std::function<void(int, int)>* _job;
+  int _count;
+  int _grain;
+  std::atomic<int> _next;
+  int _active;
+  unsigned long long _generation;
+  bool _stopping;
+  std::exception_ptr _error;
+
+  void workerLoop();
+  void runChunks();
+
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+
+public:
+  /**
+   * Starts a worker pool.
+   * @param threads the total number of threads, including the calling thread;
+   *                0 uses one thread per hardware core
+   */
+  explicit WorkerPool(int threads = 0);
+
+  /**
+   * Stops and joins all worker threads.
+   */
+  ~WorkerPool();
+
+  /**
+   * Returns the total number of threads used by parallelFor(), including the
+   * calling thread.
+   * @return the number of threads
+   */
+  int threads() const;
+
+  /**
+   * Splits the range [0, count) into chunks of at most grain items and calls
+   * fn(begin, end) for each chunk on the pool's threads. Blocks until every chunk
+   * has run. Must not be called from inside another parallelFor() job on the same
+   * pool.
+   * @param count the number of items
+   * @param grain the maximum number of items per chunk
+   * @param fn the function to run for each chunk
+   * @throws the first exception thrown by fn, after all chunks have finished
+   */
+  void parallelFor(int count, int grain, const std::function<void(int, int)>& fn);
+
+  /**
+   * Returns a process-wide pool with one thread per hardware core.
+   * @return the shared pool
+   */
+  static WorkerPool& shared();
+};
+
+#endif
@@ -0,0 +1,50 @@
+#version 330
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 texCoord;
+layout(location = 3) in vec3 norm;
+layout(location = 4) in int patchIndex;
+
+layout(std140) uniform Frame {
+  mat4 projection;
+  vec3 displacement;
+  // Nonzero to draw alpha-tested shells from the outermost one inwards.
+  int opaqueShells;
+};
+
+// Six texels per patch: the model-view matrix by columns, then
+// (displacement, shellHeight) and (shellCount, drawnShells, 0, 0).
+uniform samplerBuffer patches;
+
+// Local displacement of the hair tips by texture coordinate (see
+// DisplacementField). Reads as zero from a texture unit with nothing bound.
+uniform sampler2D displacementField;
+
+out vec2 fragTexCoord;
+out float fragLayer;
+
+void main(void) {
+  int base = patchIndex * 6;
+  mat4 modelView = mat4(texelFetch(patches, base),
+                        texelFetch(patches, base + 1),
+                        texelFetch(patches, base + 2),
+                        texelFetch(patches, base + 3));
+  vec4 patchDisplacement = texelFetch(patches, base + 4);
+  float shellHeight = patchDisplacement.w;
+  // Fewer shells may be drawn than were added (see FurLod); they are spread over
+  // the full hair length.
+  int shellCount = int(texelFetch(patches, base + 5).y);
+
+  // Every patch is drawn with one instance per shell.
+  int shell = (opaqueShells != 0) ? shellCount - 1 - gl_InstanceID : gl_InstanceID;
+  float shellLayer = float(shell) / float(max(shellCount - 1, 1));
+  vec3 shellPos = pos + norm * (shellHeight * shellLayer);
+
+  vec3 layerDisplacement = pow(shellLayer, 3.0) * (displacement +
+    patchDisplacement.xyz + texture(displacementField, texCoord).xyz);
+  vec4 newPos = vec4(shellPos + layerDisplacement, 1.0);
+  gl_Position = projection * modelView * newPos;
+
+  fragTexCoord = texCoord;
+  fragLayer = shellLayer;
+}
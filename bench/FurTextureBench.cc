@@ -0,0 +1,73 @@
+/**
+ * Measures FurTexture::generate() throughput as the number of threads grows.
+ * Usage: furtexturebench [size] [layers] [density] [seed]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "FurTexture.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+static unsigned long long checksum(const vector<RGBColor>& pixels) {
+  unsigned long long hash = 14695981039346656037ull;
+  for (const RGBColor& c : pixels) {
+    hash = (hash ^ c.r) * 1099511628211ull;
+    hash = (hash ^ c.a) * 1099511628211ull;
+  }
+  return hash;
+}
+
+int main(int argc, char** argv) {
+  int size = argc > 1 ? atoi(argv[1]) : 4096;
+  int layers = argc > 2 ? atoi(argv[2]) : 40;
+  float density = argc > 3 ? (float)atof(argv[3]) : 0.4f;
+  uint32_t seed = argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 10) : 0;
+  int maxThreads = max(1, (int)thread::hardware_concurrency());
+  
+  cout << "size=" << size << "x" << size << " layers=" << layers
+       << " density=" << density << " seed=" << seed << "\n";
+  cout << "threads\tms\tstrands/sec\tspeedup\tchecksum\n";
+  
+  vector<RGBColor> pixels;
+  double baseSeconds = 0.0;
+  unsigned long long baseChecksum = 0;
+  
+  for (int threads = 1; ; threads = min(threads * 2, maxThreads)) {
+    WorkerPool pool(threads);
+    
+    // Warm up once, then keep the best of a few runs.
+    FurTexture::generate(pixels, size, size, layers, density, seed, pool);
+    double best = 1e30;
+    long long strands = 0;
+    for (int run = 0; run < 3; run++) {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      strands = FurTexture::generate(pixels, size, size, layers, density, seed, pool);
+      chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+      best = min(best, elapsed.count());
+    }
+    
+    unsigned long long sum = checksum(pixels);
+    if (threads == 1) {
+      baseSeconds = best;
+      baseChecksum = sum;
+    }
+    
+    cout << threads << "\t" << best * 1000.0 << "\t" << strands / best << "\t"
+         << baseSeconds / best << "\t" << hex << sum << dec << "\n";
+    
+    if (sum != baseChecksum) {
+      cerr << "Output differs from the single-threaded run\n";
+      return EXIT_FAILURE;
+    }
+    
+    if (threads == maxThreads) {
+      break;
+    }
+  }
+  
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,289 @@
+/**
+ * Renders fixed scenes offscreen and compares them against reference PNGs, so
+ * that changes to the shaders or geometry cannot alter the image unnoticed. Each
+ * case is timed as well. Runs from the repository root, like the demo, and needs
+ * an OpenGL 3.3 context; the window stays hidden and software GL is fine.
+ *
+ * Images are compared in CIELAB: a pixel differs visibly if its color difference
+ * (CIE76 delta E) is above the just-noticeable 2.3. A case fails if more than
+ * 0.5% of its pixels differ visibly or if the mean delta E is above 1.
+ *
+ * Usage: goldenimages [--update] [reference directory]
+ * --update rewrites the references instead of comparing against them. Failed
+ * cases leave their image next to the reference as <case>.actual.png.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include "Exceptions.h"
+#include "Framebuffer.h"
+#include "FurScene.h"
+#include "PNGImage.h"
+
+using namespace std;
+
+static const int SIZE = 256;
+static const double TIME = 1.0;
+// The time between the frames drawn before a case's checked frame.
+static const double FRAME_STEP = 1.0 / 30.0;
+static const float COLLIDER_RADIUS = 4.0f;
+static const double MAX_VISIBLE_FRACTION = 0.005;
+static const double MAX_MEAN_DELTA_E = 1.0;
+static const double VISIBLE_DELTA_E = 2.3;
+
+struct GoldenCase {
+  const char* name;
+  FurScene::Settings settings;
+  // Frames drawn before the checked one, so that the displacement field and the
+  // deformation map have something to show.
+  int warmupFrames;
+  // Whether a ball rolls across the patch during the warmup frames.
+  bool collider;
+};
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/**
+ * The demo scene at a smaller fur map, with a fixed seed, in every shell, blend
+ * and draw mode whose image could drift.
+ */
+static vector<GoldenCase> cases() {
+  FurScene::Settings base;
+  base.furSize = 256;
+  base.furSeed = 1234;
+
+  vector<GoldenCase> all;
+  GoldenCase c = { "instanced", base };
+  all.push_back(c);
+
+  c.name = "baked";
+  c.settings = base;
+  c.settings.shellMode = FurGeometry::BAKED_SHELLS;
+  all.push_back(c);
+
+  c.name = "geometry";
+  c.settings = base;
+  c.settings.shellMode = FurGeometry::GEOMETRY_SHELLS;
+  all.push_back(c);
+
+  c.name = "float-vertices";
+  c.settings = base;
+  c.settings.vertexFormat = FurVertexFormat();
+  all.push_back(c);
+
+  c.name = "alpha-tested";
+  c.settings = base;
+  c.settings.blendMode = FurGeometry::ALPHA_TESTED_SHELLS;
+  all.push_back(c);
+
+  c.name = "rgba8";
+  c.settings = base;
+  c.settings.furFormat = FurTexture::RGBA8;
+  all.push_back(c);
+
+  c.name = "no-lod";
+  c.settings = base;
+  c.settings.lodPixels = 0.0f;
+  all.push_back(c);
+
+  c.name = "grid";
+  c.settings = base;
+  c.settings.grid = 4;
+  all.push_back(c);
+
+  // Without a budget, the field takes every step it is due, so the image does
+  // not depend on how fast the machine is.
+  c.name = "dynamics";
+  c.settings = base;
+  c.settings.fieldBudgetMs = 0.0;
+  c.warmupFrames = 30;
+  c.collider = true;
+  all.push_back(c);
+  return all;
+}
+
+/**
+ * Converts an 8-bit sRGB color to CIELAB under D65.
+ */
+static void toLab(const unsigned char* rgb, double lab[3]) {
+  double linear[3];
+  for (int i = 0; i < 3; i++) {
+    double c = rgb[i] / 255.0;
+    linear[i] = (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+  }
+
+  double xyz[3] = {
+    (0.4124 * linear[0] + 0.3576 * linear[1] + 0.1805 * linear[2]) / 0.95047,
+    0.2126 * linear[0] + 0.7152 * linear[1] + 0.0722 * linear[2],
+    (0.0193 * linear[0] + 0.1192 * linear[1] + 0.9505 * linear[2]) / 1.08883
+  };
+  for (int i = 0; i < 3; i++) {
+    xyz[i] = (xyz[i] > 216.0 / 24389.0) ? cbrt(xyz[i]) :
+      (24389.0 / 27.0 * xyz[i] + 16.0) / 116.0;
+  }
+
+  lab[0] = 116.0 * xyz[1] - 16.0;
+  lab[1] = 500.0 * (xyz[0] - xyz[1]);
+  lab[2] = 200.0 * (xyz[1] - xyz[2]);
+}
+
+/**
+ * Compares two images of the same size.
+ * @param visibleFraction receives the fraction of visibly different pixels
+ * @param meanDeltaE receives the mean color difference
+ */
+static void compare(const PNGImage& expected, const vector<unsigned char>& actual,
+  double& visibleFraction, double& meanDeltaE) {
+  const vector<png_byte>& pixels = *expected.pixels();
+  const int channels = expected.channels();
+  const size_t count = (size_t)expected.width() * expected.height();
+  size_t visible = 0;
+  double sum = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    double a[3], b[3];
+    toLab(&pixels[i * channels], a);
+    toLab(&actual[i * 4], b);
+    double deltaE = sqrt((a[0] - b[0]) * (a[0] - b[0]) +
+      (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+    sum += deltaE;
+    if (deltaE > VISIBLE_DELTA_E) {
+      visible++;
+    }
+  }
+  visibleFraction = visible / (double)count;
+  meanDeltaE = sum / count;
+}
+
+/**
+ * Renders, times and checks one case.
+ * @return whether the case passed
+ */
+static bool run(const GoldenCase& golden, const string& directory, bool update) {
+  const string reference = directory + "/" + golden.name + ".png";
+
+  glFinish();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  FurScene scene(golden.settings);
+  glFinish();
+  double buildSeconds = secondsSince(start);
+
+  Framebuffer framebuffer(SIZE, SIZE);
+  framebuffer.bind();
+  for (int frame = golden.warmupFrames; frame > 0; frame--) {
+    double time = TIME - frame * FRAME_STEP;
+    if (golden.collider && scene.deformation()) {
+      float x = (float)(time / TIME) * 20.0f - 10.0f;
+      scene.deformation()->addSphere(glm::vec3(x, 0.0f, 1.0f), COLLIDER_RADIUS);
+    }
+    scene.render(time, SIZE, SIZE);
+  }
+  glFinish();
+  start = chrono::steady_clock::now();
+  scene.render(TIME, SIZE, SIZE);
+  glFinish();
+  double renderSeconds = secondsSince(start);
+
+  shared_ptr<vector<png_byte>> pixels = make_shared<vector<png_byte>>();
+  framebuffer.resolve();
+  framebuffer.readPixels(*pixels);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  PNGImage actual(SIZE, SIZE, 4, pixels);
+
+  cout << golden.name << "\t" << buildSeconds * 1000.0 << "\t"
+       << renderSeconds * 1000.0 << "\t";
+  if (update) {
+    actual.save(reference.c_str());
+    cout << "updated\n";
+    return true;
+  }
+
+  bool passed = false;
+  try {
+    PNGImage expected(reference.c_str());
+    if (expected.width() != SIZE || expected.height() != SIZE) {
+      cout << "FAILED (reference is " << expected.width() << "x"
+           << expected.height() << ")\n";
+    }
+    else {
+      double visibleFraction, meanDeltaE;
+      compare(expected, *pixels, visibleFraction, meanDeltaE);
+      passed = visibleFraction <= MAX_VISIBLE_FRACTION &&
+        meanDeltaE <= MAX_MEAN_DELTA_E;
+      cout << (passed ? "ok" : "FAILED") << " (" << visibleFraction * 100.0
+           << "% visible, mean delta E " << meanDeltaE << ")\n";
+    }
+  }
+  catch (const IOError&) {
+    cout << "FAILED (no reference; run with --update)\n";
+  }
+
+  if (!passed) {
+    actual.save((directory + "/" + golden.name + ".actual.png").c_str());
+  }
+  return passed;
+}
+
+int main(int argc, char** argv) {
+  bool update = false;
+  string directory = "bench/golden";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--update") == 0) {
+      update = true;
+    }
+    else {
+      directory = argv[i];
+    }
+  }
+
+  if (!glfwInit()) {
+    return EXIT_FAILURE;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow* window = glfwCreateWindow(SIZE, SIZE, "goldenimages", NULL, NULL);
+  if (!window) {
+    glfwTerminate();
+    return EXIT_FAILURE;
+  }
+  glfwMakeContextCurrent(window);
+  glewExperimental = true;
+  if (glewInit() != GLEW_OK) {
+    glfwTerminate();
+    return EXIT_FAILURE;
+  }
+  cout << "OpenGL version: " << glGetString(GL_VERSION) << "\n";
+  cout << "case\tbuild ms\trender ms\tresult\n";
+
+  int failures = 0;
+  for (const GoldenCase& golden : cases()) {
+    try {
+      if (!run(golden, directory, update)) {
+        failures++;
+      }
+    }
+    catch (const runtime_error& e) {
+      cout << "FAILED (" << e.what() << ")\n";
+      failures++;
+    }
+  }
+
+  if (failures > 0) {
+    cout << failures << " of " << cases().size() << " cases failed\n";
+  }
+  glfwTerminate();
+  return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
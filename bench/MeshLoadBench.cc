@@ -0,0 +1,184 @@
+/**
+ * Measures how long Mesh takes to load a torus written as OBJ, ASCII PLY and
+ * binary PLY, and how normal generation scales with threads. The files are
+ * written to a scratch directory first; loads are timed with the files in the
+ * page cache, so they measure parsing rather than the disk.
+ * Usage: meshloadbench [triangles] [directory]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Exceptions.h"
+#include "Mesh.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+static const float TWO_PI = 6.2831853f;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/**
+ * Returns the point of a torus at (u, v), both from 0 to 1.
+ */
+static void torus(float u, float v, float xyz[3]) {
+  float ring = 3.0f + cos(TWO_PI * v);
+  xyz[0] = ring * cos(TWO_PI * u);
+  xyz[1] = ring * sin(TWO_PI * u);
+  xyz[2] = sin(TWO_PI * v);
+}
+
+/**
+ * Writes a rows x columns torus. The OBJ has a UV seam where the texture wraps,
+ * like a real asset; the PLY files simply repeat the seam's vertices.
+ * @return whether the file could be written
+ */
+static bool writeTorus(const string& fileName, int rows, int columns,
+  const char* format) {
+  FILE* file = fopen(fileName.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  const bool obj = (string(format) == "obj");
+  const bool binary = (string(format) == "binary");
+  const int vertices = (rows + 1) * (columns + 1);
+  const int faces = rows * columns;
+  if (!obj) {
+    fprintf(file, "ply\nformat %s 1.0\nelement vertex %d\n"
+      "property float x\nproperty float y\nproperty float z\n"
+      "property float u\nproperty float v\nelement face %d\n"
+      "property list uchar int vertex_indices\nend_header\n",
+      binary ? "binary_little_endian" : "ascii", vertices, faces);
+  }
+  
+  // Little-endian hosts only; that is all this benchmark runs on.
+  for (int row = 0; row <= rows; row++) {
+    for (int column = 0; column <= columns; column++) {
+      float uv[2] = { column / (float)columns, row / (float)rows };
+      float xyz[3];
+      torus(uv[0], uv[1], xyz);
+      if (obj) {
+        fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\n", xyz[0], xyz[1], xyz[2],
+          uv[0], uv[1]);
+      }
+      else if (binary) {
+        fwrite(xyz, sizeof(float), 3, file);
+        fwrite(uv, sizeof(float), 2, file);
+      }
+      else {
+        fprintf(file, "%.6f %.6f %.6f %.6f %.6f\n", xyz[0], xyz[1], xyz[2], uv[0],
+          uv[1]);
+      }
+    }
+  }
+  
+  // Quads, wrapping around in the OBJ so that the seam shares positions.
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      int a = row * (columns + 1) + column;
+      int b = a + 1;
+      int c = a + columns + 1;
+      int d = c + 1;
+      if (obj) {
+        int pa = (row % rows) * (columns + 1) + column % columns;
+        int pb = (row % rows) * (columns + 1) + (column + 1) % columns;
+        int pc = ((row + 1) % rows) * (columns + 1) + column % columns;
+        int pd = ((row + 1) % rows) * (columns + 1) + (column + 1) % columns;
+        fprintf(file, "f %d/%d %d/%d %d/%d %d/%d\n", pa + 1, a + 1, pb + 1, b + 1,
+          pd + 1, d + 1, pc + 1, c + 1);
+      }
+      else if (binary) {
+        unsigned char corners = 4;
+        int indices[4] = { a, b, d, c };
+        fwrite(&corners, 1, 1, file);
+        fwrite(indices, sizeof(int), 4, file);
+      }
+      else {
+        fprintf(file, "4 %d %d %d %d\n", a, b, d, c);
+      }
+    }
+  }
+  
+  long size = ftell(file);
+  bool written = !ferror(file);
+  fclose(file);
+  cout << "wrote " << fileName << " (" << size / 1e6 << " MB)\n";
+  return written;
+}
+
+int main(int argc, char** argv) {
+  long long triangles = argc > 1 ? atoll(argv[1]) : 2000000;
+  string directory = argc > 2 ? argv[2] : ".";
+  int maxThreads = max(1, (int)thread::hardware_concurrency());
+  
+  // Two triangles per quad, with twice as many columns as rows.
+  int rows = max(2, (int)sqrt(triangles / 4.0));
+  int columns = rows * 2;
+  const char* formats[] = { "obj", "ascii", "binary" };
+  const char* extensions[] = { ".obj", ".ply", ".bin.ply" };
+  vector<string> fileNames;
+  for (int i = 0; i < 3; i++) {
+    fileNames.push_back(directory + "/meshloadbench" + extensions[i]);
+    if (!writeTorus(fileNames.back(), rows, columns, formats[i])) {
+      cerr << "Could not write " << fileNames.back() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  
+  cout << "triangles=" << rows * columns * 2 << " threads=" << maxThreads << "\n";
+  cout << "format\tvertices\tload ms\n";
+  try {
+    for (int i = 0; i < 3; i++) {
+      // The first load brings the file into the page cache.
+      Mesh(fileNames[i].c_str());
+      double best = 1e30;
+      size_t vertices = 0;
+      for (int run = 0; run < 3; run++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Mesh mesh(fileNames[i].c_str());
+        best = min(best, secondsSince(start));
+        vertices = mesh.vertices().size();
+      }
+      cout << formats[i] << "\t" << vertices << "\t" << best * 1000.0 << "\n";
+    }
+  
+    // Normals alone, as the thread count grows.
+    cout << "threads\tnormals ms\tspeedup\n";
+    Mesh mesh(fileNames[2].c_str());
+    double baseSeconds = 0.0;
+    for (int threads = 1; ; threads = min(threads * 2, maxThreads)) {
+      WorkerPool pool(threads);
+      double best = 1e30;
+      for (int run = 0; run < 3; run++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        mesh.computeNormals(pool);
+        best = min(best, secondsSince(start));
+      }
+      if (threads == 1) {
+        baseSeconds = best;
+      }
+      cout << threads << "\t" << best * 1000.0 << "\t" << baseSeconds / best << "\n";
+      if (threads == maxThreads) {
+        break;
+      }
+    }
+  }
+  catch (const runtime_error& e) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  
+  for (const string& fileName : fileNames) {
+    remove(fileName.c_str());
+  }
+  return EXIT_SUCCESS;
+}
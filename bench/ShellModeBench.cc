@@ -0,0 +1,174 @@
+/**
+ * Compares the build and draw times of baked, instanced and geometry-shader
+ * shells across mesh sizes, with float and compact vertex formats. Draw times
+ * include glFinish(), so they approximate GPU time per frame. Needs an OpenGL
+ * 3.3 context; the window stays hidden.
+ * Usage: shellmodebench [layers] [frames]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "FurGeometry.h"
+#include "FurTexture.h"
+#include "ShaderProgram.h"
+#include "UniformBuffer.h"
+
+using namespace std;
+
+static const int SIZE = 512;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/**
+ * Builds a flat n x n grid of quads facing +z, 40 units across.
+ */
+static void buildGrid(int n, vector<FurAttributes>& vertices,
+  vector<GLuint>& indices) {
+  vertices.clear();
+  indices.clear();
+  for (int row = 0; row <= n; row++) {
+    for (int col = 0; col <= n; col++) {
+      float u = col / (float)n;
+      float v = row / (float)n;
+      FurAttributes fa = {{ u * 40.0f - 20.0f, v * 40.0f - 20.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f }, { u, v }, 0.0f };
+      vertices.push_back(fa);
+    }
+  }
+
+  for (int row = 0; row < n; row++) {
+    for (int col = 0; col < n; col++) {
+      GLuint a = row * (n + 1) + col;
+      GLuint b = a + 1;
+      GLuint c = a + (n + 1);
+      GLuint d = c + 1;
+      indices.push_back(a); indices.push_back(b); indices.push_back(d);
+      indices.push_back(a); indices.push_back(d); indices.push_back(c);
+    }
+  }
+}
+
+static void run(const char* name, ShaderProgram& prog, int n, int layers,
+  int frames, FurGeometry::ShellMode mode, const char* formatName,
+  const FurVertexFormat& format, UniformRing& ring, const glm::mat4& view) {
+  vector<FurAttributes> vertices;
+  vector<GLuint> indices;
+  buildGrid(n, vertices, indices);
+
+  prog.use();
+  glFinish();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  FurGeometry geom(vertices, indices, prog, layers, 2, mode, format);
+  glFinish();
+  double buildSeconds = secondsSince(start);
+
+  // One warm-up frame, so that shader and buffer setup is not timed.
+  ring.beginFrame();
+  geom.draw(ring, view);
+  ring.endFrame();
+  glFinish();
+
+  start = chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    ring.beginFrame();
+    geom.draw(ring, view);
+    ring.endFrame();
+  }
+  glFinish();
+  double drawSeconds = secondsSince(start) / frames;
+
+  cout << name << "\t" << formatName << "\t"
+       << format.vertexSize(mode == FurGeometry::BAKED_SHELLS) << "\t" << n * n * 2
+       << "\t" << buildSeconds * 1000.0 << "\t" << drawSeconds * 1000.0 << "\n";
+}
+
+int main(int argc, char** argv) {
+  int layers = argc > 1 ? atoi(argv[1]) : 40;
+  int frames = argc > 2 ? atoi(argv[2]) : 100;
+
+  if (!glfwInit()) {
+    return EXIT_FAILURE;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow* window = glfwCreateWindow(SIZE, SIZE, "shellmodebench", NULL, NULL);
+  if (!window) {
+    glfwTerminate();
+    return EXIT_FAILURE;
+  }
+  glfwMakeContextCurrent(window);
+  glewExperimental = true;
+  if (glewInit() != GLEW_OK) {
+    glfwTerminate();
+    return EXIT_FAILURE;
+  }
+  cout << "OpenGL version: " << glGetString(GL_VERSION) << "\n";
+
+  ShaderProgram vertexProg("default.vert", "default.frag");
+  ShaderProgram geometryProg("shells.vert", "default.frag", "shells.geom");
+  ShaderProgram* programs[] = { &vertexProg, &geometryProg };
+  for (ShaderProgram* prog : programs) {
+    prog->use();
+    prog->bindUniformBlock("Frame", FurGeometry::FRAME_BINDING);
+    prog->bindUniformBlock("Object", FurGeometry::OBJECT_BINDING);
+    glUniform1i(prog->getUniform("fur"), 0);
+    glUniform1i(prog->getUniform("color"), 1);
+    // No displacement field or deformation map is bound there, so shells only
+    // sway uniformly.
+    glUniform1i(prog->getUniform("displacementField"), 3);
+    glUniform1i(prog->getUniform("deformationMap"), 4);
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+  FurTexture fur(256, 256, layers, 0.4f);
+
+  glViewport(0, 0, SIZE, SIZE);
+  FurGeometry::setBlendMode(FurGeometry::BLENDED_SHELLS);
+
+  glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -30.0f)) *
+    glm::rotate(glm::mat4(1.0f), glm::radians(-60.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+  UniformBlock<FurFrameUniforms> frameUniforms;
+  FurFrameUniforms frame = FurFrameUniforms();
+  frame.projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 100.0f);
+  frame.displacement = glm::vec3(0.0f, -0.8f, 0.0f);
+  frameUniforms.set(frame);
+  frameUniforms.bind(FurGeometry::FRAME_BINDING);
+  UniformRing ring;
+
+  cout << "layers=" << layers << " frames=" << frames << "\n";
+  cout << "mode\tformat\tbytes/vertex\ttriangles\tbuild ms\tdraw ms\n";
+
+  const char* formatNames[] = { "float", "compact" };
+  FurVertexFormat formats[] = { FurVertexFormat(), FurVertexFormat::compact() };
+  for (int n = 4; n <= 256; n *= 4) {
+    for (int f = 0; f < 2; f++) {
+      // Baked shells copy the mesh once per layer; skip any that need
+      // hundreds of megabytes.
+      if ((size_t)(n + 1) * (n + 1) * layers < (1u << 24)) {
+        run("baked", vertexProg, n, layers, frames, FurGeometry::BAKED_SHELLS,
+          formatNames[f], formats[f], ring, view);
+      }
+      run("instanced", vertexProg, n, layers, frames,
+        FurGeometry::INSTANCED_SHELLS, formatNames[f], formats[f], ring, view);
+      if (layers <= FurGeometry::MAX_GEOMETRY_SHELLS) {
+        run("geometry", geometryProg, n, layers, frames,
+          FurGeometry::GEOMETRY_SHELLS, formatNames[f], formats[f], ring, view);
+      }
+    }
+  }
+
+  glfwTerminate();
+  return EXIT_SUCCESS;
+}
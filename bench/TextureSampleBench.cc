@@ -0,0 +1,107 @@
+/**
+ * Compares Texture::sample() with looping over Texture::texel().
+ * Usage: texturesamplebench [png] [samples]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "Texture.h"
+
+using namespace std;
+
+/**
+ * Runs fn a few times and returns the best time in seconds.
+ */
+template <typename Fn>
+static double bestOf(Fn fn) {
+  double best = 1e30;
+  for (int run = 0; run < 5; run++) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    fn();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    best = min(best, elapsed.count());
+  }
+  return best;
+}
+
+static void report(const char* name, size_t samples, double seconds,
+  double baseline) {
+  cout << name << "\t" << samples / seconds / 1e6 << "\t" << baseline / seconds
+       << "\n";
+}
+
+int main(int argc, char** argv) {
+  const char* fileName = argc > 1 ? argv[1] : "grass.png";
+  size_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : 1 << 22;
+  
+  Texture texture(fileName, Texture::CPU_ONLY);
+  const int width = texture.width();
+  const int height = texture.height();
+  
+  vector<glm::vec2> uvs(count);
+  srand(1);
+  for (size_t i = 0; i < count; i++) {
+    uvs[i] = glm::vec2(rand() / (float)RAND_MAX * 4.0f - 2.0f,
+                       rand() / (float)RAND_MAX * 4.0f - 2.0f);
+  }
+  vector<RGBColor> out(count);
+  
+  cout << fileName << " " << width << "x" << height << ", " << count
+       << " samples\n";
+  cout << "method\tMsamples/s\tspeedup\n";
+  
+  // Nearest, one texel() call per sample.
+  double texelNearest = bestOf([&] {
+    for (size_t i = 0; i < count; i++) {
+      int col = (int)((uvs[i].x - floor(uvs[i].x)) * width) % width;
+      int row = (int)((uvs[i].y - floor(uvs[i].y)) * height) % height;
+      texture.texel(col, height - row - 1, out[i]);
+    }
+  });
+  report("texel nearest", count, texelNearest, texelNearest);
+  
+  double batchNearest = bestOf([&] {
+    texture.sample(uvs.data(), count, out.data(), Texture::NEAREST);
+  });
+  report("sample nearest", count, batchNearest, texelNearest);
+  
+  // Bilinear, four texel() calls and a float blend per sample.
+  double texelBilinear = bestOf([&] {
+    for (size_t i = 0; i < count; i++) {
+      float x = (uvs[i].x - floor(uvs[i].x)) * width - 0.5f;
+      float y = (uvs[i].y - floor(uvs[i].y)) * height - 0.5f;
+      int x0 = (int)floor(x);
+      int y0 = (int)floor(y);
+      float fx = x - x0;
+      float fy = y - y0;
+      int col0 = (x0 + width) % width;
+      int col1 = (x0 + 1) % width;
+      int row0 = height - 1 - (y0 + height) % height;
+      int row1 = height - 1 - (y0 + 1) % height;
+      
+      RGBColor c00, c10, c01, c11;
+      texture.texel(col0, row0, c00);
+      texture.texel(col1, row0, c10);
+      texture.texel(col0, row1, c01);
+      texture.texel(col1, row1, c11);
+      
+      float w00 = (1 - fx) * (1 - fy), w10 = fx * (1 - fy);
+      float w01 = (1 - fx) * fy, w11 = fx * fy;
+      out[i] = RGBColor(
+        (unsigned char)(c00.r * w00 + c10.r * w10 + c01.r * w01 + c11.r * w11),
+        (unsigned char)(c00.g * w00 + c10.g * w10 + c01.g * w01 + c11.g * w11),
+        (unsigned char)(c00.b * w00 + c10.b * w10 + c01.b * w01 + c11.b * w11),
+        (unsigned char)(c00.a * w00 + c10.a * w10 + c01.a * w01 + c11.a * w11));
+    }
+  });
+  report("texel bilinear", count, texelBilinear, texelBilinear);
+  
+  double batchBilinear = bestOf([&] {
+    texture.sample(uvs.data(), count, out.data(), Texture::BILINEAR);
+  });
+  report("sample bilinear", count, batchBilinear, texelBilinear);
+  
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+/**
+ * Compares the per-frame cost of looking up the demo's uniforms by name in a
+ * std::map (the old ShaderProgram path) with LocationTable.
+ * Usage: uniformlookupbench [frames]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include "LocationTable.h"
+
+using namespace std;
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+static const char* NAMES[] = {
+  "modelView", "projection", "fur", "color", "displacement", "shellCount",
+  "shellHeight"
+};
+static const int NAME_COUNT = sizeof(NAMES) / sizeof(NAMES[0]);
+
+/**
+ * The uniforms one frame of the demo touches; "wind" is not in the program.
+ */
+static const char* FRAME[] = {
+  "projection", "displacement", "shellCount", "shellHeight", "wind"
+};
+static const int FRAME_COUNT = sizeof(FRAME) / sizeof(FRAME[0]);
+
+/**
+ * The lookup ShaderProgram used to do: a string by value, a map, and an exception
+ * for anything that is not cached. A miss would then ask OpenGL, which always
+ * answers -1 here.
+ */
+static GLint mapLookup(map<string, GLint>& names, string name) {
+  try {
+    return names.at(name);
+  }
+  catch (out_of_range& e) {
+    return -1;
+  }
+}
+
+/**
+ * Runs fn for the given number of frames and reports the time and allocations
+ * per frame.
+ */
+template <typename Fn>
+static void run(const char* name, int frames, Fn fn) {
+  long long sink = 0;
+  size_t before = allocations;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    for (int i = 0; i < FRAME_COUNT; i++) {
+      sink += fn(FRAME[i]);
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  cout << name << "\t" << elapsed.count() / frames * 1e9 << "\t"
+       << (double)(allocations - before) / frames << "\t" << sink << "\n";
+}
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  map<string, GLint> names;
+  LocationTable table;
+  for (int i = 0; i < NAME_COUNT; i++) {
+    names[NAMES[i]] = i;
+    table.insert(NAMES[i], i);
+  }
+
+  cout << frames << " frames, " << FRAME_COUNT << " lookups per frame\n";
+  cout << "method\tns/frame\tallocs/frame\tchecksum\n";
+
+  run("std::map", frames, [&](const char* name) {
+    return mapLookup(names, name);
+  });
+  run("LocationTable", frames, [&](const char* name) {
+    return table.find(name);
+  });
+
+  return EXIT_SUCCESS;
+}
@@ -6,16 +6,29 @@ in float fragLayer;
 uniform sampler2D fur;
 uniform sampler2D color;
 
+layout(std140) uniform Frame {
+  mat4 projection;
+  vec3 displacement;
+  int opaqueShells;
+};
+
 out vec4 outputColor;
 
 void main(void) {
   float fakeShadow = mix(0.4, 1.0, fragLayer);
   
-  vec4 furData = texture(fur, fragTexCoord);
+  // Only the strand height is needed, so the fur map may be R8 or RGBA8. Pixels
+  // without a strand have height 0, which only the base layer reaches.
+  float strandHeight = texture(fur, fragTexCoord).r;
   vec4 furColor = texture(color, fragTexCoord) * fakeShadow;
   
-  float visibility = (fragLayer > furData.r) ? 0.0 : furData.a;
+  float visibility = (fragLayer > strandHeight) ? 0.0 : 1.0;
   furColor.a = (fragLayer == 0.0) ? 1.0 : visibility;
   
+  // Alpha-tested shells keep depth writes meaningful: only hair is drawn.
+  if (opaqueShells != 0 && furColor.a == 0.0) {
+    discard;
+  }
+  
   outputColor = furColor;
 }
\ No newline at end of file
@@ -3,20 +3,59 @@
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec2 texCoord;
 layout(location = 2) in float layer;
-//layout(location = 3) in vec3 norm;
+layout(location = 3) in vec3 norm;
 
-uniform mat4 modelView;
-uniform mat4 projection;
-uniform vec3 displacement;
+layout(std140) uniform Frame {
+  mat4 projection;
+  vec3 displacement;
+  // Nonzero to draw alpha-tested shells from the outermost one inwards.
+  int opaqueShells;
+};
+
+layout(std140) uniform Object {
+  mat4 modelView;
+  // Number of instanced shells, or 0 if the shells are baked into the vertex buffer.
+  int shellCount;
+  float shellHeight;
+  // Nonzero if norm holds a packed normal in xy.
+  int packedNormals;
+};
+
+// Local displacement of the hair tips by texture coordinate (see
+// DisplacementField). Reads as zero from a texture unit with nothing bound.
+uniform sampler2D displacementField;
+// Where colliders pushed the hair aside (see DeformationMap). Bends the hair from
+// the root up rather than at the tips.
+uniform sampler2D deformationMap;
 
 out vec2 fragTexCoord;
 out float fragLayer;
 
+// Unfolds an octahedron-encoded normal (see FurVertexFormat).
+vec3 unpackNormal(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
 void main(void) {
-  vec3 layerDisplacement = pow(layer, 3.0) * displacement;
-  vec4 newPos = vec4(pos + layerDisplacement, 1.0);
+  float shellLayer = layer;
+  vec3 shellPos = pos;
+  if (shellCount > 0) {
+    int shell = (opaqueShells != 0) ? shellCount - 1 - gl_InstanceID : gl_InstanceID;
+    shellLayer = float(shell) / float(max(shellCount - 1, 1));
+    vec3 normal = (packedNormals != 0) ? unpackNormal(norm.xy) : norm;
+    shellPos = pos + normal * (shellHeight * shellLayer);
+  }
+
+  vec3 layerDisplacement = pow(shellLayer, 3.0) *
+    (displacement + texture(displacementField, texCoord).xyz) +
+    shellLayer * texture(deformationMap, texCoord).xyz;
+  vec4 newPos = vec4(shellPos + layerDisplacement, 1.0);
   gl_Position = projection * modelView * newPos;
   
   fragTexCoord = texCoord;
-  fragLayer = layer;
+  fragLayer = shellLayer;
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 330
+
+// Passes the base mesh through in model space; shells.geom extrudes the shells.
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 texCoord;
+layout(location = 3) in vec3 norm;
+
+layout(std140) uniform Object {
+  mat4 modelView;
+  int shellCount;
+  float shellHeight;
+  // Nonzero if norm holds a packed normal in xy.
+  int packedNormals;
+};
+
+out vec3 geomNorm;
+out vec2 geomTexCoord;
+
+// Unfolds an octahedron-encoded normal (see FurVertexFormat).
+vec3 unpackNormal(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
+void main(void) {
+  gl_Position = vec4(pos, 1.0);
+  geomNorm = (packedNormals != 0) ? unpackNormal(norm.xy) : norm;
+  geomTexCoord = texCoord;
+}